@@ -8,6 +8,13 @@
 #include <sys/socket.h>
 #include <map>
 
+// Fan-out totals shared by every channel. Timing, allocations and the
+// split by command and channel size come from bench/microbench fanout.
+struct FanoutStats {
+	unsigned long		broadcasts;
+	unsigned long		recipients;
+	unsigned long long	bytes;
+};
 
 class Channel 
 {
@@ -21,14 +28,23 @@ class Channel
 		std::map<char, bool> modes;
 		
 		int UserLimit; 
+		// where the ChannelTable built this channel
+		int _slot;
+
+		void	recordFanout(std::size_t length, std::size_t recipients) const;
 
 	public:
-		Channel(std::string &channelName, Client *client);
+		static FanoutStats	fanout;
+
+		Channel(const std::string &channelName, Client *client);
+		// channels stay where the ChannelTable built them
+		Channel(const Channel &other) = delete;
+		Channel &operator=(const Channel &other) = delete;
 		~Channel();
 
 		//SEND TO OTHERS
-		void	broadcastMessage(const std::string message);
-		void	sendToOthers(Client *client, std::string message);
+		void	broadcastMessage(const std::string &message);
+		void	sendToOthers(Client *client, const std::string &message);
 		//ADD FUNCTIONS		
 		void addClient(Client *client);
 		void inviteClient(Client *client);
@@ -36,22 +52,27 @@ class Channel
 
 		//REMOVE FUNCTIONS
 		void removeClient(Client *client);
-		void removeInvite(std::string &invite);
+		void removeInvite(const std::string &invite);
+		void releaseInvites();
 		void removeOperator(std::string nickname);
 		void removeKey();
 		void removeUserLimit();
 
 		void	updateNickname(std::string oldNick, std::string newNick);
+		void	replaceClient(Client *from, Client *to);
 		
 		//GETTERS
 		std::string getKey( void ) const;
-		std::map<std::string, Client *> getUsers() const;
+		const std::map<std::string, Client *> &getUsers() const;
 		std::string  getUsersList();
 		int		getUserLimit() const;
 		std::string getModes() const;
 		std::string getChannelName() const;
 		std::string getTopic() const;
 		std::map<char, bool> getModesMap() const;
+		std::size_t	heapBytes() const;
+		int			getSlot() const { return _slot; }
+		void		setSlot(int slot) { _slot = slot; }
 
 		//SETTERS
 		void setTopic(std::string &topic);
@@ -62,7 +83,7 @@ class Channel
 
 		//CHECK FUNCTIONS
 		bool isClientInChannel(std::string nickname);
-		bool isOperator(std::string &nickname);
+		bool isOperator(const std::string &nickname) const;
 		bool isInvited(std::string nickname);
 		bool checkMode(char c);
 
@@ -0,0 +1,55 @@
+#pragma once
+#ifndef CHANNELTABLE_HPP
+# define CHANNELTABLE_HPP
+
+#include "./Channel.hpp"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+
+// Channels are built in place in fixed blocks that never move, so a
+// Channel & stays valid until that channel is removed; freed slots are
+// reused before a new block is allocated. Lookups go through a hash index
+// on the ASCII case-folded name, and removal is O(1) since every channel
+// knows its own slot.
+class ChannelTable {
+
+	private:
+
+		static const std::size_t	BLOCK_SIZE = 64;
+
+		std::vector<Channel *>					_blocks;
+		std::vector<unsigned char>				_live;
+		std::vector<int>						_free;
+		std::unordered_map<std::string, int>	_index;
+		std::size_t								_count;
+
+		Channel		*slot( int id ) const;
+
+		ChannelTable( const ChannelTable &other );
+		ChannelTable	&operator=( const ChannelTable &other );
+
+	public:
+
+		ChannelTable( void );
+		~ChannelTable( void );
+
+		static std::string	fold( const std::string &name );
+
+		Channel		*find( const std::string &name ) const;
+		// the creator joins as the channel's first operator
+		Channel		&create( const std::string &name, Client *creator );
+		void		erase( Channel &channel );
+		void		clear( void );
+
+		// next channel slot after id, -1 when there is none; next(-1) is the first
+		int			next( int id ) const;
+		Channel		&at( int id ) const { return *slot(id); }
+		std::size_t	size( void ) const { return _count; }
+		// blocks, free list and index; the channels' own maps are counted
+		// by Channel::heapBytes()
+		std::size_t	heapBytes( void ) const;
+};
+
+#endif /* CHANNELTABLE_HPP */
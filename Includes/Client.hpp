@@ -4,30 +4,155 @@
 
 #include <string>
 #include <vector>
+#include <deque>
+#include <set>
 #include "./IrcException.hpp"
+#include "./DeflateStream.hpp"
+#include "./ReplyQueue.hpp"
 #include <unistd.h>
 #include <cstring>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <ctime>
 
+// Registration steps; a client is welcomed once all of them are done
+enum RegistrationFlag {
+	REG_CAP_STARTED	= 1,
+	REG_PASS		= 2,
+	REG_NICK		= 4,
+	REG_USER		= 8,
+	REG_CAP_ENDED	= 16,
+	// granted by the admission pacer once the steps above are done
+	REG_ADMITTED	= 32,
+	REG_COMPLETE	= 63
+};
+
+// Scheduling class, used as the weight of a client's per-round budget
+enum ClientPriority {
+	PRIORITY_NORMAL	= 1,
+	// service bots and other clients connecting from PRIORITY_FILE addresses
+	PRIORITY_HIGH	= 4
+};
+
+#if defined(__linux__) && defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+# define IRC_ZEROCOPY 1
+#endif
+
+// Output handed to the kernel by a MSG_ZEROCOPY send: either the bytes
+// of the DEFLATE buffer, or references to the queued chunks they came from
+struct PinnedOutput {
+	unsigned int				seq;
+	std::string					bytes;
+	std::vector<OutputBuffer *>	buffers;
+};
+
+// Drops the entries whose seq is in [first, last] (wrapping), giving the
+// chunks they referenced back; returns how many were dropped
+std::size_t	releasePinnedRange( std::deque<PinnedOutput> &pinned, unsigned int first, unsigned int last );
+
+# define NICKLEN 30
+// Buffers that grew past this during a burst are released once they
+// drain, so an idle connection does not keep its high-water mark
+# define IDLE_BUFFER_CAPACITY 512
+
+// Identity and bookkeeping that the per-event path never reads, kept out
+// of line so the Client itself stays small
+struct ClientIdentity {
+	std::string				username;
+	std::string				hostname;
+	sockaddr_in				address;
+	long long				connectedAt;
+	// CAP resume: the token a reconnect can present to take this
+	// session over
+	std::string				resumeToken;
+	// channels that hold this client as a member or an invite, so
+	// teardown only visits those
+	std::set<std::string>	memberships;
+	std::set<std::string>	invites;
+};
+
+// Memory budget per idle, registered connection (64-bit, excluding the
+// kernel's socket buffers): about 200 bytes of Client, 220 of
+// ClientIdentity, a pollfd and a ClientTable slot, plus one nickname
+// entry; under 1 KiB with allocator overhead. Each channel membership
+// adds a node in the channel's user map and one in memberships, roughly
+// 200 bytes. Input, output and reply queues give back what a burst grew
+// them to once drained (see trimBuffers()) and everything once the
+// client has been idle a while (see hibernate()); compression and
+// zero-copy state is only allocated once used. Process RSS runs higher
+// (loadgen idle: about 1.5 KiB per connection and 800 bytes per
+// membership) since malloc keeps the pages the registration and JOIN
+// bursts grew the heap to.
 class Client {
 
 	private:
 
+		// hot: read for every event on this client
 		int							_fd;
+		int							_registration;
+		// a handler is suspended on an async operation; further lines
+		// stay buffered so per-client command order is preserved
+		bool						_suspended;
+		// has complete lines left over after its per-round budget and
+		// sits on the server's ready list until they are processed
+		bool						_ready;
+		// QUIT or a dropped connection queued it for closing at the end
+		// of the iteration; none of its input is processed meanwhile
+		bool						_closing;
+		unsigned char				_priority;
+		// a detached session has no socket but still collects channel
+		// traffic for replay
+		bool						_detached;
 		bool						_isCorrectPassword;
-		std::string					_nickname;
-		std::string					_username;
-		std::string					_channel;
+		bool						_resumeRequested;
+		bool						_resumed;
+		// buffers were released by hibernate(); cleared on the next read
+		bool						_hibernating;
+		unsigned char				_nickLength;
+		char						_nickname[NICKLEN + 1];
+		time_t						_lastActivity;
+		// clients with a socket that are not hibernating, least recently
+		// active first: touch() moves one to the back, so the idle sweep
+		// walks from the front and stops at the first one not yet idle
+		Client						*_idlePrev;
+		Client						*_idleNext;
+		static Client				*_idleHead;
+		static Client				*_idleTail;
+		static std::size_t			_hibernatingTotal;
+		unsigned long				_generation;
+		static unsigned long		_nextGeneration;
 		std::string					_messageBuffer;
-		
+		std::string					_outBuffer;
+		// bytes waiting in every client's _outBuffer
+		static std::size_t			_outBufferTotal;
+
+		// CAP compress: replies up to and including the CAP ACK are sent
+		// raw, the stream switches to DEFLATE from _compressionStart on
+		DeflateStream				*_deflate;
+		bool						_compressionPending;
+		std::size_t					_compressionStart;
+
+		// MSG_ZEROCOPY: buffers handed to the kernel stay pinned here
+		// until the error queue reports their send as complete
+		bool						_zeroCopy;
+		unsigned int				_zeroCopySeq;
+		// allocated on the first zero-copy send, dropped once it drains
+		std::deque<PinnedOutput>	*_zeroCopyPinned;
+
+		// cold
+		ClientIdentity				*_identity;
+
+		Client( const Client &other );
+		Client	&operator=( const Client &other );
+		void		linkIdle( void );
+		void		unlinkIdle( void );
 
 	public:
 		
-		bool						isRegistered;
-		std::vector<std::string>	serverReplies;
-		bool	conRegi[3];
+		ReplyQueue					serverReplies;
 		Client( void );
 		Client( int fd );
+		~Client( void );
 
 		bool		sendMessage( const std::string &message );
 		
@@ -36,17 +161,87 @@ class Client {
 		void		setNickname( const std::string &nickname );
 		void		setUsername( const std::string &username );
 		void		setFd(int value);
+		void		setHostname( const std::string &hostname );
+		void		setAddress( const sockaddr_in &address );
+		void		setSuspended( bool suspended );
+		void		setReady( bool ready );
+		void		setClosing( void );
+		void		setPriority( ClientPriority priority );
+		void		touch( void );
+		void		addRegistration( int flags );
 		
 		void		appendToBuffer(const std::string& data);
 		std::string&	getBuffer();
 		void		clearBuffer();
+
+		void		flushReplies( int compressionLevel );
+		void		trimBuffers( void );
+		std::size_t	hibernate( void );
+		bool		isHibernating( void ) const;
+		static Client		*leastRecentlyActive( void ) { return _idleHead; }
+		Client		*nextByActivity( void ) const { return _idleNext; }
+		static std::size_t	hibernatingTotal( void ) { return _hibernatingTotal; }
+		std::string&	getOutBuffer();
+		// drops the first `bytes` of _outBuffer once they are sent
+		void		consumeOutput( std::size_t bytes );
+		static std::size_t	outBufferTotal( void ) { return _outBufferTotal; }
+		bool		compressesOutput( void ) const;
+
+		void		startCompression( void );
+
+		void		requestResume( void );
+		bool		wantsResume( void ) const;
+		void		setResumeToken( const std::string &token );
+		const std::string	&getResumeToken( void ) const;
+		void		setResumed( bool resumed );
+		bool		isResumed( void ) const;
+		void		setDetached( bool detached );
+		bool		isDetached( void ) const;
+		bool		isReachable( void ) const;
+
+		void		addMembership( const std::string &channelName );
+		void		removeMembership( const std::string &channelName );
+		const std::set<std::string>	&getMemberships( void ) const;
+		void		addInvite( const std::string &channelName );
+		void		removeInvite( const std::string &channelName );
+		const std::set<std::string>	&getInvites( void ) const;
+		const DeflateStream	*getDeflateStream( void ) const;
+
+		bool		enableZeroCopy( void );
+		void		disableZeroCopy( void );
+		bool		isZeroCopyEnabled( void ) const;
+		void		pinOutput( std::size_t bytesSent );
+		void		pinQueued( std::size_t bytesSent );
+		std::size_t	releasePinned( unsigned int first, unsigned int last );
+		std::size_t	getPinnedCount( void ) const;
+		// hands the pinned queue over to the caller, for a socket that is
+		// closing while the kernel may still read from it
+		std::deque<PinnedOutput>	*takePinned( void );
+		// charges this client's heap to `self`, its buffers to input
+		// and output; a detached session charges everything to `self`
+		void		measureMemory( MemoryUsage &usage, MemoryTag self ) const;
 		
 		//GETTERS
 		std::string getFullIdentity( void ) const;
-		std::string &getNickname( void ) const;
-		std::string getUsername( void ) const;
+		std::string getNickname( void ) const;
+		bool		hasNickname( const std::string &nickname ) const;
+		const std::string &getUsername( void ) const;
+		std::string getHostname( void ) const;
+		const sockaddr_in &getAddress( void ) const;
+		bool		isSuspended( void ) const;
+		bool		isReady( void ) const;
+		bool		isClosing( void ) const;
+		ClientPriority	getPriority( void ) const;
+		bool		hasPendingOutput( void ) const;
+		// exact bytes waiting to be sent, queued or already deflated
+		std::size_t	pendingBytes( void ) const;
+		time_t		getLastActivity( void ) const;
+		long long	getConnectedAt( void ) const;
+		int			getRegistration( void ) const;
+		bool		isFullyRegistered( void ) const;
 		bool		getIsCorrectPassword( void ) const;
 		int			getFd( void ) const;
+		ClientHandle	getHandle( void ) const;
 };
 
 #endif /* CLIENT_HPP */
\ No newline at end of file
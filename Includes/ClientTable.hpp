@@ -0,0 +1,56 @@
+#pragma once
+#ifndef CLIENTTABLE_HPP
+# define CLIENTTABLE_HPP
+
+#include <vector>
+#include <cstddef>
+
+class Client;
+
+// What a descriptor is, so the poll loop can dispatch on one byte
+enum FdKind {
+	FD_FREE = 0,
+	FD_LISTENER,
+	FD_CLIENT,
+	FD_ADMIN,
+	FD_LOOKUP,
+	// a closed client's socket kept open for its zero-copy completions
+	FD_DRAIN
+};
+
+// Clients indexed directly by fd. The slots are small and contiguous, so
+// dispatching a ready descriptor reads one entry instead of walking a
+// tree; the Client objects themselves stay where they were allocated.
+class ClientTable {
+
+	private:
+
+		struct Slot {
+			Client			*client;
+			unsigned char	kind;
+		};
+
+		std::vector<Slot>	_slots;
+		std::size_t			_count;
+
+		void		grow( int fd );
+
+	public:
+
+		ClientTable( void );
+
+		void		reserve( std::size_t fds );
+		void		insert( int fd, Client *client );
+		void		erase( int fd );
+		void		setKind( int fd, FdKind kind );
+
+		FdKind		kindOf( int fd ) const;
+		Client		*find( int fd ) const;
+		// next client fd after fd, -1 when there is none; next(-1) is the first
+		int			next( int fd ) const;
+		std::size_t	size( void ) const { return _count; }
+		std::size_t	capacity( void ) const { return _slots.capacity(); }
+		std::size_t	heapBytes( void ) const { return _slots.capacity() * sizeof(Slot); }
+};
+
+#endif /* CLIENTTABLE_HPP */
@@ -0,0 +1,53 @@
+#pragma once
+#ifndef DEFLATESTREAM_HPP
+# define DEFLATESTREAM_HPP
+
+#include <string>
+#include <zlib.h>
+
+// One zlib stream per connection. Each flush of the output queue is
+// compressed as one unit and ended with Z_SYNC_FLUSH, so the client can
+// decode everything it has received without waiting for more data.
+class DeflateStream {
+
+	private:
+
+		z_stream		_stream;
+		int				_level;
+		bool			_ready;
+
+		// per-connection cost accounting
+		unsigned long	_rawBytes;
+		unsigned long	_compressedBytes;
+		long long		_cpuMicros;
+
+		// the same over every stream since startup, closed ones included,
+		// and the streams open now
+		static unsigned long long	_totalRawBytes;
+		static unsigned long long	_totalCompressedBytes;
+		static long long			_totalCpuMicros;
+		static std::size_t			_openStreams;
+
+		DeflateStream( const DeflateStream &other );
+		DeflateStream	&operator=( const DeflateStream &other );
+
+	public:
+
+		explicit DeflateStream( int level );
+		~DeflateStream( void );
+
+		bool			compress( const std::string &input, std::string &output, int level );
+
+		bool			isReady( void ) const { return _ready; }
+		int				getLevel( void ) const { return _level; }
+		unsigned long	getRawBytes( void ) const { return _rawBytes; }
+		unsigned long	getCompressedBytes( void ) const { return _compressedBytes; }
+		long long		getCpuMicros( void ) const { return _cpuMicros; }
+
+		static unsigned long long	totalRawBytes( void ) { return _totalRawBytes; }
+		static unsigned long long	totalCompressedBytes( void ) { return _totalCompressedBytes; }
+		static long long			totalCpuMicros( void ) { return _totalCpuMicros; }
+		static std::size_t			openStreams( void ) { return _openStreams; }
+};
+
+#endif /* DEFLATESTREAM_HPP */
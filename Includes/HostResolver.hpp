@@ -0,0 +1,68 @@
+#pragma once
+#ifndef HOSTRESOLVER_HPP
+# define HOSTRESOLVER_HPP
+
+#include "Task.hpp"
+
+#ifdef IRC_COROUTINES
+
+#include "ReplyQueue.hpp"
+#include <netdb.h>
+#include <netinet/in.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One reverse DNS lookup. Workers only touch address and host; the rest
+// belongs to the event loop.
+struct HostLookup {
+	sockaddr_in					address;
+	char						host[NI_MAXHOST];
+	ClientHandle				client;
+	// null once the client has gone; the result is then dropped
+	std::coroutine_handle<>		waiter;
+	std::string					*result;
+};
+
+// A fixed set of worker threads resolving HostLookups. Finished lookups
+// are collected by the event loop, which polls one wake pipe for all of
+// them. The resolver owns every lookup submitted to it until collect()
+// hands it back.
+class HostResolver {
+
+	public:
+
+		HostResolver( void );
+		~HostResolver( void );
+
+		bool						start( std::size_t workers );
+		// Joins the workers, waiting for lookups already running, and
+		// frees the lookups that never came back
+		void						stop( void );
+
+		int							getWakeFd( void ) const { return _pipe[0]; }
+		void						submit( HostLookup *lookup );
+		void						collect( std::vector<HostLookup *> &done );
+
+	private:
+
+		std::vector<std::thread>	_workers;
+		std::mutex					_mutex;
+		std::condition_variable		_wake;
+		std::deque<HostLookup *>	_queue;
+		std::vector<HostLookup *>	_done;
+		bool						_stopping;
+		int							_pipe[2];
+
+		void						work( void );
+
+		HostResolver( const HostResolver & );
+		HostResolver				&operator=( const HostResolver & );
+};
+
+#endif /* IRC_COROUTINES */
+
+#endif /* HOSTRESOLVER_HPP */
@@ -6,7 +6,7 @@
 #include <iostream>
 #include <cerrno>
 #include <arpa/inet.h>
-#include <sys/select.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #include <fcntl.h>
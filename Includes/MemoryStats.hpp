@@ -0,0 +1,68 @@
+#pragma once
+#ifndef MEMORYSTATS_HPP
+# define MEMORYSTATS_HPP
+
+#include <string>
+#include <cstddef>
+
+// Subsystems heap memory is charged to
+enum MemoryTag {
+	MEM_CLIENTS = 0,
+	MEM_CHANNELS,
+	MEM_INPUT,
+	MEM_OUTPUT,
+	// detached sessions kept for CAP resume, with their replay queues
+	MEM_HISTORY,
+	// fd table, pollfds, nickname list and the other lookup structures
+	MEM_INDEXES,
+	MEM_PARSER,
+	MEM_COMPRESSION,
+	MEM_TAGS
+};
+
+// One measurement of where the heap is going
+struct MemoryUsage {
+	std::size_t		bytes[MEM_TAGS];
+
+	MemoryUsage( void );
+
+	void			charge( MemoryTag tag, std::size_t amount ) { bytes[tag] += amount; }
+	std::size_t		total( void ) const;
+};
+
+// Blocks the server allocates itself (output chunks, zlib state) are
+// counted as they are allocated and freed; container memory is measured
+// from capacities when a snapshot is taken. Sizes include malloc's block
+// header and rounding, so the figures line up with RSS rather than with
+// sizeof.
+class MemoryAccount {
+
+	private:
+
+		static std::size_t	_live[MEM_TAGS];
+		static std::size_t	_peak[MEM_TAGS];
+
+	public:
+
+		static void			allocate( MemoryTag tag, std::size_t bytes );
+		static void			release( MemoryTag tag, std::size_t bytes ) { _live[tag] -= bytes; }
+		// for short-lived memory such as a parsed line: only its peak
+		// is kept, since it is gone again before any snapshot
+		static void			observe( MemoryTag tag, std::size_t bytes );
+		// folds a snapshot into the high-water marks
+		static void			record( const MemoryUsage &usage );
+
+		static std::size_t	live( MemoryTag tag ) { return _live[tag]; }
+		static std::size_t	peak( MemoryTag tag ) { return _peak[tag]; }
+		static const char	*tagName( int tag );
+		static long			residentBytes( void );
+
+		// heap cost of one malloc block of `bytes`
+		static std::size_t	block( std::size_t bytes );
+		// heap owned by a string; short strings live inside the object
+		static std::size_t	string( const std::string &text );
+		// one node of a std::map or std::set holding a `value`-byte entry
+		static std::size_t	treeNode( std::size_t value );
+};
+
+#endif /* MEMORYSTATS_HPP */
@@ -14,6 +14,7 @@
 # define RPL_ISUPPORT(client, tokens) (":localhost 005 " + client + " " + tokens " :are supported by this server\r\n")
 
 # define ERR_UNKNOWNCOMMAND(client, command) (":localhost 421 " + client + " " + command + " :Unknown command\r\n")
+# define ERR_INVALIDUTF8(command) (":localhost FAIL " + command + " INVALID_UTF8 :Message rejected, this server only accepts UTF-8\r\n")
 
 // INVITE
 # define ERR_NEEDMOREPARAMS(client, command) (":localhost 461 " + client + " " + command + " :Not enough parameters.\r\n")
@@ -51,6 +52,7 @@
 #define RPL_CHANNELMODEIS(client, channel, mode) (":localhost 324 " + client + " " + channel + " :" + mode + "\r\n")
 #define RPL_CHANNELMODEISWITHKEY(client, channel, mode, password) (":localhost 324 " + client + " " + channel + " " + mode + " " + password + "\r\n")
 #define ERR_CANNOTSENDTOCHAN(client, channel) ("404 " + client + " " + channel + " :Cannot send to channel\r\n")
+#define ERR_CANNOTSENDTOUSER(client, target) (":localhost 531 " + client + " " + target + " :Cannot send to user\r\n")
 #define ERR_CHANNELISFULL(client, channel) ("471 " + client + " " + channel + " :Cannot join channel (+l)\r\n")
 #define ERR_CHANOPRIVSNEEDED(client, channel) (":localhost 482 " + client + " " + channel + " :You're not channel operator\r\n")
 #define ERR_WRONGMODEPARAMS(client, channel, mode) (":localhost 482 " + client + " " + channel + " :Not the correct type of parameters given for " + mode "\r\n")
@@ -100,6 +102,11 @@
 # define RPL_QUIT(user_id, reason) (user_id + " QUIT :Quit: " + reason + "\r\n")
 # define RPL_ERROR(user_id, reason) (user_id + " ERROR :" + reason + "\r\n")
 
+// RESUME
+# define RPL_RESUMETOKEN(token) (":localhost RESUME TOKEN " + token + "\r\n")
+# define RPL_RESUMESUCCESS(nick) (":localhost RESUME SUCCESS " + nick + "\r\n")
+# define ERR_RESUMEFAIL(code, reason) (":localhost FAIL RESUME " + code + " :" + reason + "\r\n")
+
 // PRIVMSG
 #define ERR_NOSUCHNICK(client, target) ("401 " + client + " " + target + " :No such nick/channel\r\n")
 #define ERR_NORECIPIENT(client) ("411 " + client + " :No recipient given PRIVMSG\r\n")
@@ -2,6 +2,7 @@
 #ifndef PARSEMESG_HPP
 #define PARSEMESG_HPP
 
+#include "ScratchArena.hpp"
 
 
 class ParseMessage {
@@ -11,25 +12,28 @@ class ParseMessage {
 		int 						_msgLen;
 		std::string					_msg;
 		std::string					_cmd;
-		std::vector<std::string>	_params;
+		// in the scratch arena: a ParseMessage lives for one line only
+		ScratchVector<std::string>	_params;
 		std::string					_trailing;
 		bool						_notValidParam;
 		std::string					_errorMsg;
 
 	public:
 
-		ParseMessage( const std::string &message );
+		explicit ParseMessage( std::string message );
 
 		void 						displayCommand(  const ParseMessage &parsedMessage ) const;
 		bool						isValid( const std::string &param ) const;
 		std::string					ft_trim( const std::string &str ) const;
-
-		int							getMsgLen( void ) const { return _msgLen; }
-		std::string					getMsg( void ) const { return _msg; }
-		std::string					getCmd( void ) const { return _cmd; }
-		std::vector<std::string>	getParams( void ) const { return _params; }
-		std::string					getTrailing( void ) const { return _trailing; }
-		std::string					getErrorMsg( void ) const { return _errorMsg; }
+		// heap held by the parsed fields
+		std::size_t					footprint( void ) const;
+
+		int									getMsgLen( void ) const { return _msgLen; }
+		const std::string					&getMsg( void ) const { return _msg; }
+		const std::string					&getCmd( void ) const { return _cmd; }
+		const ScratchVector<std::string>	&getParams( void ) const { return _params; }
+		const std::string					&getTrailing( void ) const { return _trailing; }
+		const std::string					&getErrorMsg( void ) const { return _errorMsg; }
 };
 
 #endif /* PARSEMSG_HPP */
\ No newline at end of file
@@ -0,0 +1,159 @@
+#pragma once
+#ifndef REPLYQUEUE_HPP
+# define REPLYQUEUE_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <sys/uio.h>
+#include "./MemoryStats.hpp"
+
+class Client;
+
+// Refers to a client across loop iterations. It resolves to nothing once
+// that client is gone, even if its fd has been handed to a new connection.
+struct ClientHandle {
+	int				fd;
+	unsigned long	generation;
+};
+
+// A reference-counted block of output bytes. Pooled chunks are filled with
+// one client's replies; an exact-size buffer holds a broadcast line shared
+// by every recipient, or a reply too large for a chunk.
+class OutputBuffer {
+
+	private:
+
+		char			*_data;
+		std::size_t		_size;
+		std::size_t		_capacity;
+		unsigned int	_refs;
+
+		static std::vector<OutputBuffer *>	_pool;
+		// fewest free chunks since the last trimPool(): that many were
+		// never needed and can go back to the allocator
+		static std::size_t					_poolLow;
+		// exact-size buffers made by create()
+		static unsigned long				_created;
+
+		explicit OutputBuffer( std::size_t capacity );
+		~OutputBuffer( void );
+		OutputBuffer( const OutputBuffer &other );
+		OutputBuffer	&operator=( const OutputBuffer &other );
+
+	public:
+
+		static const std::size_t	CHUNK_SIZE = 2048;
+		// free chunks kept for reuse; the rest go back to the allocator
+		static const std::size_t	POOL_MAX = 1024;
+
+		static OutputBuffer	*chunk( void );
+		static OutputBuffer	*create( const std::string &bytes );
+		static std::size_t	pooled( void ) { return _pool.size(); }
+		static unsigned long	created( void ) { return _created; }
+		static void			resetCreated( void ) { _created = 0; }
+		static void			releasePool( void );
+		// returns the bytes released
+		static std::size_t	trimPool( void );
+
+		void			retain( void ) { ++_refs; }
+		void			release( void );
+		void			append( const char *bytes, std::size_t length );
+
+		const char		*data( void ) const { return _data; }
+		std::size_t		size( void ) const { return _size; }
+		std::size_t		space( void ) const { return _capacity - _size; }
+};
+
+struct OutputSegment {
+	OutputBuffer	*buffer;
+	unsigned int	offset;
+	unsigned int	length;
+};
+
+// A client's pending output: one segment per reply, each pointing into a
+// pooled chunk or a shared buffer, written out with writev(). The first
+// reply queued on an empty queue puts its owner on `pending`, the list of
+// clients the server flushes at the end of the loop iteration.
+class ReplyQueue {
+
+	private:
+
+		std::vector<OutputSegment>	_segments;
+		// first segment not yet fully sent
+		std::size_t					_head;
+		std::size_t					_bytes;
+		// segments from _head that stay in front of later control
+		// replies: those control replies, and a head already started on
+		std::size_t					_front;
+		bool						_started;
+		// control replies may jump ahead of bulk output; off once a
+		// DEFLATE stream fixes the order of what is queued
+		bool						_reorder;
+		// set once the owner is a detached session: the newest replies
+		// kept for replay; such a queue is left out of totalBytes()
+		std::size_t					_replayLimit;
+		// this client's chunk still being filled
+		OutputBuffer				*_tail;
+		Client						*_owner;
+
+		// bytes queued on every counted queue
+		static std::size_t			_totalBytes;
+
+		void	notify( void );
+		void	addBytes( std::size_t bytes );
+		void	removeBytes( std::size_t bytes );
+		void	checkLimit( std::size_t added );
+		void	insert( const OutputSegment &segment, bool control );
+		void	popFront( void );
+		void	logSent( const OutputSegment &segment ) const;
+
+		ReplyQueue( const ReplyQueue &other );
+		ReplyQueue	&operator=( const ReplyQueue &other );
+
+	public:
+
+		static std::vector<ClientHandle>	pending;
+		// clients whose queue went past SENDQ_MAX; the server
+		// disconnects them once the loop iteration is over
+		static std::vector<ClientHandle>	overflowed;
+		// room for a NAMES burst from a very large channel
+		static const std::size_t			SENDQ_MAX = 4 * 1024 * 1024;
+
+		ReplyQueue( void );
+		~ReplyQueue( void );
+
+		void		setOwner( Client *owner );
+		void		setReorder( bool reorder );
+		// from now on keeps only the newest `replayLines` replies
+		void		detach( std::size_t replayLines );
+
+		void		push_back( const std::string &reply );
+		void		pushShared( OutputBuffer *buffer );
+		// takes over every segment of `other`, leaving it empty
+		void		append( ReplyQueue &other );
+		void		dropFront( std::size_t count );
+		void		dropStarted( void );
+		void		clear( void );
+		void		shrink( void );
+
+		// iovecs for up to `max` queued segments, returns how many
+		int			fill( struct iovec *iov, int max ) const;
+		void		consume( std::size_t bytes );
+		// keeps the buffers behind the first `bytes` alive for the kernel
+		void		retainFront( std::size_t bytes, std::vector<OutputBuffer *> &pins ) const;
+		// appends the first `count` replies to `out` and drops them
+		void		moveTo( std::string &out, std::size_t count );
+
+		std::size_t	size( void ) const { return _segments.size() - _head; }
+		bool		empty( void ) const { return _head == _segments.size(); }
+		// exact bytes still to be sent
+		std::size_t	bytes( void ) const { return _bytes; }
+		// the segment list itself; the chunks it points into are
+		// counted as they are allocated
+		std::size_t	heapBytes( void ) const;
+
+		static std::size_t	totalBytes( void ) { return _totalBytes; }
+};
+
+#endif /* REPLYQUEUE_HPP */
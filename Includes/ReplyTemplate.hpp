@@ -0,0 +1,33 @@
+#pragma once
+#ifndef REPLYTEMPLATE_HPP
+# define REPLYTEMPLATE_HPP
+
+#include <string>
+#include <vector>
+
+// Placeholders understood by ReplyTemplate::compile()
+# define TEMPLATE_NICK "\x01N"
+# define TEMPLATE_USER "\x01U"
+
+// A multi-line reply formatted once with placeholders for the per-client
+// fields, then rendered into a single buffer with one allocation.
+class ReplyTemplate {
+
+	private:
+
+		enum Field { FIELD_NICK, FIELD_USER };
+
+		std::vector<std::string>	_literals;
+		std::vector<Field>			_fields;
+		std::size_t					_literalSize;
+
+	public:
+
+		ReplyTemplate( void );
+
+		void			compile( const std::string &formatted );
+		std::string		render( const std::string &nickname, const std::string &username ) const;
+		bool			empty( void ) const { return _literals.empty(); }
+};
+
+#endif /* REPLYTEMPLATE_HPP */
@@ -0,0 +1,93 @@
+#pragma once
+#ifndef SCRATCHARENA_HPP
+# define SCRATCHARENA_HPP
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+// Bump allocator for temporaries that live no longer than one client's
+// batch of lines: parsed parameters, split lists and the like. Freeing is
+// a no-op (bar the most recent allocation, so a growing vector can reuse
+// its own tail); everything is reclaimed at once when the outermost Scope
+// ends, by rewinding to the first block. Blocks are kept for the next
+// batch, so a warmed-up server makes no malloc calls for these at all.
+class ScratchArena {
+
+	private:
+
+		static const std::size_t	BLOCK_SIZE = 16384;
+
+		struct Block {
+			char		*data;
+			std::size_t	size;
+		};
+
+		std::vector<Block>	_blocks;
+		std::size_t			_current;
+		std::size_t			_used;
+		int					_depth;
+		std::size_t			_bytes;
+
+		void		nextBlock( std::size_t bytes );
+
+		ScratchArena( const ScratchArena &other );
+		ScratchArena	&operator=( const ScratchArena &other );
+
+	public:
+
+		// one arena serves the whole loop, which runs on a single thread
+		static ScratchArena	instance;
+
+		// The arena is reset when the outermost scope closes, so a batch
+		// that reaches another client's batch (a resume, say) is safe.
+		class Scope {
+			public:
+				Scope( void ) { ++instance._depth; }
+				~Scope( void ) { if (--instance._depth == 0) instance.reset(); }
+			private:
+				Scope( const Scope &other );
+				Scope	&operator=( const Scope &other );
+		};
+
+		ScratchArena( void );
+		~ScratchArena( void );
+
+		void		*allocate( std::size_t bytes );
+		void		deallocate( void *address, std::size_t bytes );
+		void		reset( void );
+
+		// bytes held in blocks, used or not
+		std::size_t	capacity( void ) const { return _bytes; }
+};
+
+// Standard allocator over ScratchArena::instance, for containers that
+// must not outlive the current Scope
+template <class T>
+class ScratchAllocator {
+
+	public:
+
+		typedef T	value_type;
+
+		ScratchAllocator( void ) {}
+		template <class U>
+		ScratchAllocator( const ScratchAllocator<U> & ) {}
+
+		T		*allocate( std::size_t count ) {
+			return static_cast<T *>(ScratchArena::instance.allocate(count * sizeof(T)));
+		}
+		void	deallocate( T *address, std::size_t count ) {
+			ScratchArena::instance.deallocate(address, count * sizeof(T));
+		}
+};
+
+template <class T, class U>
+bool	operator==( const ScratchAllocator<T> &, const ScratchAllocator<U> & ) { return true; }
+template <class T, class U>
+bool	operator!=( const ScratchAllocator<T> &, const ScratchAllocator<U> & ) { return false; }
+
+template <class T>
+using ScratchVector = std::vector<T, ScratchAllocator<T> >;
+
+#endif /* SCRATCHARENA_HPP */
@@ -8,22 +8,165 @@
 #include "ParseMessage.hpp"
 #include "Client.hpp"
 #include "./Channel.hpp"
+#include "ChannelTable.hpp"
+#include "SpamFilter.hpp"
+#include "Utf8.hpp"
+#include "Task.hpp"
+#include "HostResolver.hpp"
+#include "ReplyTemplate.hpp"
+#include "ClientTable.hpp"
 
 #include <map>
+#include <unordered_map>
 #include <vector>
+#include <deque>
 #include <fstream>
 
 class Channel;
 
+# define ADMIN_SOCKET_PATH "./ircserv.sock"
+// Source addresses whose connections get PRIORITY_HIGH, one per line
+# define PRIORITY_FILE "./PRIORITY.txt"
+
+// A registered client whose connection dropped, kept until it resumes or
+// its grace period runs out
+struct DetachedSession {
+	Client										*client;
+	// its entry in Server::_sessionExpiries
+	std::multimap<long long, std::string>::iterator	expiry;
+};
+
+// A connection on the local admin socket. Long dumps are produced a slice
+// at a time so a large server never stalls the loop for the whole dump.
+struct AdminSession {
+	enum Dump { DUMP_NONE, DUMP_CLIENTS, DUMP_CHANNELS };
+
+	std::string		input;
+	std::string		output;
+	Dump			dump;
+	int				clientCursor;
+	int				channelCursor;
+	bool			firstEntry;
+
+	AdminSession( void ) : dump(DUMP_NONE), clientCursor(-1), channelCursor(-1), firstEntry(true) {}
+};
+
+// A closed client's MSG_ZEROCOPY buffers that the kernel may still be
+// reading. The socket stays open, shut down for writing, until their
+// completions arrive or the deadline passes.
+struct ZeroCopyDrain {
+	std::deque<PinnedOutput>	*pinned;
+	long long					deadline;
+};
+
+// What a command leaves of its client's batch
+enum CommandResult {
+	COMMAND_DONE = 0,
+	// the client is closing; the rest of its input is dropped
+	COMMAND_CLOSE
+};
+
+// A client to tear down once the loop iteration is over
+struct PendingClose {
+	ClientHandle	client;
+	std::string		reason;
+	// a dropped connection may be kept for CAP resume, a QUIT never is
+	bool			detach;
+};
+
+// Overload governor levels; each level also applies every measure below it
+enum OverloadLevel {
+	LOAD_NORMAL = 0,
+	LOAD_PAUSE_ACCEPT,
+	LOAD_DEFER_REGISTRATION,
+	LOAD_REDUCE_READS,
+	LOAD_SHED_TRAFFIC
+};
 
 class Server {
 
 	private:
 
-		static const int				MAX_CLIENTS = FD_SETSIZE;
-		static const int				BUFFER_SIZE = 1024;
+		// RLIMIT_NOFILE is raised towards this at startup; fd-indexed
+		// tables are presized from whatever limit was granted
+		static const rlim_t				MAX_DESCRIPTORS = 1 << 20;
+		// one recv() per POLLIN; larger than BYTES_PER_ROUND, so a burst
+		// is read in one call and the round budget decides how much of it
+		// runs now
+		static const int				BUFFER_SIZE = 16384;
+		// UTF8ONLY: inbound lines must be valid UTF-8. Invalid sequences
+		// are replaced with U+FFFD, or the whole line is rejected.
+		static const bool				UTF8_ONLY = true;
+		static const bool				UTF8_REPLACE = true;
+		// DEFLATE level bounds for CAP compress, scaled by loop CPU headroom
+		static const int				COMPRESSION_MIN_LEVEL = 1;
+		static const int				COMPRESSION_MAX_LEVEL = 6;
+		static const int				METRICS_INTERVAL = 10;
+		// MSG_ZEROCOPY only pays off for large writes: below 32 KB pinning
+		// pages and reaping completions costs more than the copy it saves
+		// (bench/microbench zerocopy)
+		static const std::size_t		ZEROCOPY_THRESHOLD = 32768;
+		// how long a closed socket waits for its zero-copy completions
+		// before it is reset, which drops whatever the kernel still held
+		static const int				ZEROCOPY_DRAIN_SECONDS = 10;
+		// queued segments gathered into one writev()
+		static const int				OUTPUT_IOV_MAX = 64;
+		// entries an admin dump may emit per loop iteration
+		static const int				ADMIN_SLICE = 256;
+		// unsent output past which an admin session runs no further
+		// commands or dump slices until its reader catches up, and the
+		// longest command line it may send
+		static const std::size_t		ADMIN_OUTPUT_MAX = 1024 * 1024;
+		static const std::size_t		ADMIN_INPUT_MAX = 4096;
+		// overload governor: evaluated once per window, moving one level
+		// up when either signal is over its limit and one level down when
+		// both are under half of it
+		static const int				OVERLOAD_WINDOW_MS = 250;
+		static const long long			OVERLOAD_ITERATION_US = 50000;
+		static const std::size_t		OVERLOAD_QUEUE_BYTES = 64 * 1024 * 1024;
+		static const std::size_t		OVERLOAD_LARGE_CHANNEL = 500;
+		static const int				OVERLOAD_READ_SIZE = 256;
+		// unprocessed input an unregistered client may pile up, e.g. while
+		// its registration is deferred; registering takes a few short lines
+		static const std::size_t		UNREGISTERED_INPUT_MAX = 4096;
+		// CAP resume: how long a dropped session is held, and how many
+		// missed lines it keeps for replay (oldest are dropped first)
+		static const int				RESUME_GRACE_PERIOD = 60;
+		static const std::size_t		RESUME_REPLAY_LINES = 256;
+		// registration admission: welcomes completed per second and the
+		// burst allowed after an idle spell; known addresses and resumed
+		// sessions take PRIORITY_SHARE of every PRIORITY_SHARE + 1 slots
+		static const int				REGISTRATION_RATE = 500;
+		static const int				REGISTRATION_BURST = 100;
+		static const bool				REGISTRATION_PRIORITY = true;
+		static const unsigned int		PRIORITY_SHARE = 3;
+		static const std::size_t		KNOWN_ADDRESSES_MAX = 65536;
+		// connections accepted per loop iteration, and the listen backlog
+		// that holds the rest of a reconnect storm meanwhile
+		static const int				ACCEPT_BATCH = 64;
+		// reverse DNS worker threads in the coroutine build
+		static const std::size_t		RESOLVER_THREADS = 4;
+		// lines and bytes one client may have processed per round; the
+		// rest waits on the ready list so a flood can't delay others
+		// (false turns this off, for loadgen fairness)
+		static const bool				READ_BUDGET = true;
+		static const int				LINES_PER_ROUND = 16;
+		static const std::size_t		BYTES_PER_ROUND = 4096;
+		// a client that has sent nothing for this long gives its buffers
+		// back; checked every IDLE_SWEEP_INTERVAL seconds, which also
+		// trims output chunks the pool didn't need since the last sweep
+		static const int				IDLE_HIBERNATE_SECONDS = 60;
+		static const int				IDLE_SWEEP_INTERVAL = 5;
 
 		int								_listeningSocket;
+		int								_adminSocket;
+		// held open so an EMFILE accept can still take the connection
+		// off the backlog and close it instead of polling it forever
+		int								_spareFd;
+		rlim_t							_descriptorLimit;
+		unsigned long					_rejectedConnections;
+		std::map<int, AdminSession>		_adminSessions;
+		unsigned long					_iterations;
 		std::string						_serverPassword;
 		int								_serverPort;
 		std::string						_message;
@@ -31,17 +174,100 @@ class Server {
 		int								_hintLen;
 		char							_host[NI_MAXHOST];
 		char							_svc[NI_MAXSERV];
-		std::map<int, Client*>			_clients;
-		std::map<std::string, Channel>	_channels;
-		std::vector<std::string>		_nicknames;
+		ClientTable						_clients;
+		ChannelTable					_channels;
+		// every nick in use, case-folded, including those of detached
+		// sessions; a Client * since a detached one has no fd to resolve
+		std::unordered_map<std::string, Client *>	_nicknames;
 
 		std::vector<pollfd>				_fds;
+		// where each fd's entry sits in _fds, -1 when it has none
+		std::vector<int>				_pollSlots;
+		// entries released this iteration, removed by compactPollFds()
+		std::vector<int>				_releasedSlots;
+		// pollfds opened while _fds is being iterated, appended afterwards
+		std::vector<pollfd>				_deferredFds;
+		// clients with buffered lines past their budget, served again
+		// at the end of each iteration in arrival order
+		std::deque<ClientHandle>		_readyClients;
+		std::vector<PendingClose>		_pendingCloses;
+		unsigned long					_budgetDeferrals;
+		long long						_lastIdleSweep;
+		unsigned long					_hibernations;
+		unsigned long long				_reclaimedBytes;
+		std::set<in_addr_t>				_priorityAddresses;
+		SpamFilter						*_spamFilter;
+		int								_compressionLevel;
+		long long						_busyMicros;
+		long long						_lastMetrics;
+		unsigned long					_copySends;
+		unsigned long					_copyBytes;
+		unsigned long					_zeroCopySends;
+		unsigned long					_zeroCopyBytes;
+		unsigned long					_zeroCopyCopied;
+		std::map<int, ZeroCopyDrain>	_zeroCopyDrains;
+
+		OverloadLevel					_overloadLevel;
+		long long						_overloadWindowStart;
+		long long						_worstIteration;
+		std::size_t						_queuedBytes;
+		std::set<int>					_deferredRegistrations;
+		unsigned long					_overloadTransitions;
+		unsigned long					_shedMessages;
+
+		// 001-005 and MOTD, formatted once and rendered per client
+		ReplyTemplate					_welcomeTemplate;
+		unsigned long					_welcomes;
+		long long						_welcomeMicros;
+		long long						_welcomeWorst;
+
+		std::map<std::string, DetachedSession>	_detachedSessions;
+		// resume tokens by expiry time, soonest first
+		std::multimap<long long, std::string>	_sessionExpiries;
+		unsigned long					_resumes;
+		unsigned long					_resumesExpired;
+
+		std::deque<ClientHandle>		_admissionQueue;
+		std::deque<ClientHandle>		_priorityAdmissions;
+		std::set<in_addr_t>				_knownAddresses;
+		double							_admissionCredit;
+		long long						_lastAdmission;
+		unsigned int					_prioritySlots;
+		unsigned long					_admitted;
+		unsigned long					_admittedPriority;
+
+		struct RegistrationStep {
+			const char	*command;
+			int			needs;
+			int			(Server::*handler)( Client *client, const ParseMessage &parsedMsg );
+		};
+		static const RegistrationStep	_registrationSteps[];
+
+#ifdef IRC_COROUTINES
+		HostResolver					_resolver;
+		// the lookup each suspended client is waiting on, by client fd
+		std::map<int, HostLookup *>		_lookups;
+#endif
 
 		static Server*					_instance;
 
-		Server( void ) {}
+		// bench/microbench runs handlers on clients that have no socket
+		friend class					ServerBench;
 
-		void            handleNewConnection(void);
+		Server( void ) : _adminSocket(-1), _spareFd(-1), _descriptorLimit(0), _rejectedConnections(0), _iterations(0), _budgetDeferrals(0),
+			_lastIdleSweep(0), _hibernations(0), _reclaimedBytes(0), _spamFilter(NULL), _compressionLevel(COMPRESSION_MAX_LEVEL),
+			_busyMicros(0), _lastMetrics(0), _copySends(0), _copyBytes(0),
+			_zeroCopySends(0), _zeroCopyBytes(0), _zeroCopyCopied(0),
+			_overloadLevel(LOAD_NORMAL), _overloadWindowStart(0), _worstIteration(0),
+			_queuedBytes(0), _overloadTransitions(0), _shedMessages(0),
+			_welcomes(0), _welcomeMicros(0), _welcomeWorst(0),
+			_resumes(0), _resumesExpired(0),
+			_admissionCredit(REGISTRATION_BURST), _lastAdmission(0), _prioritySlots(0),
+			_admitted(0), _admittedPriority(0) {}
+
+		bool            handleNewConnection(void);
+		void			raiseDescriptorLimit(void);
+		void			rejectConnection(void);
 		int     		ft_recv( int fd );
 		void            cleanupServer(void);
 		void 			displayCommand(  const ParseMessage &parsedMessage ) const;
@@ -49,16 +275,86 @@ class Server {
 		//CLIENT FUNCTIONS
 		void			handleClientDisconnection(int client_fd, int bytesRecv);
 		void            handleClientMessage(int client_fd);
-		void            closeClient(int client_fd);
+		void			processBufferedLines(Client *client);
+		void			processReadyClients(void);
+		void			hibernateIdleClients(long long now);
+		void			flushPendingReplies(void);
+		void			enforceSendQueues(void);
+		int				pollTimeout(void) const;
+		void			scheduleClose( Client *client, const std::string &reason, bool detach );
+		void			processPendingCloses( void );
+		void			releasePollFd( int fd );
+		void			teardownClient( Client *client, const std::string &reason );
+		Client			*resolveClient( const ClientHandle &handle );
 		void			sendToClient( int client_fd );
+		ssize_t			sendOutput( Client *client );
+		ssize_t			sendQueued( Client *client );
+		void			reapZeroCopyCompletions( int client_fd );
+		void			closeClientSocket( Client *client );
+		void			drainZeroCopy( pollfd &pfd );
+		void			expireZeroCopyDrains( long long now );
+		void			addPollFd( int fd, short events );
+		void			appendPollFd( int fd, short events );
+		pollfd			*findPollFd( int fd );
+		void			compactPollFds( void );
+
+		//ADMIN SOCKET
+		void			initAdminSocket( void );
+		void			handleAdminEvent( pollfd &pfd );
+		void			closeAdminSession( int fd );
+		void			runAdminCommand( AdminSession &session, const std::string &line );
+		void			advanceAdminDump( AdminSession &session );
+		std::string		adminClientJson( Client *client, long now ) const;
+		std::string		adminChannelJson( const Channel &channel ) const;
+		std::string		adminStatsJson( void ) const;
+		std::string		adminFanoutJson( void ) const;
+		std::string		adminMemoryJson( void ) const;
+		bool			adminDisconnect( const std::string &target );
+
+		//OVERLOAD GOVERNOR
+		void			updateOverload( long long now, long long iterationMicros );
+		void			setOverloadLevel( OverloadLevel level );
+		bool			deferRegistration( Client *client );
+		void			resumeDeferredRegistrations( void );
+		int				readBudget( void ) const;
+		bool			shouldShed( const Channel &channel );
+
+		//ASYNC TASKS
+		void			completeHostLookup( pollfd &pfd );
+		void			cancelClientTasks( int client_fd );
+#ifdef IRC_COROUTINES
+		Task			welcomeUser( Client *client );
+		bool			startHostLookup( Client *client, std::coroutine_handle<> waiter, std::string *result );
+		void			startHostResolver( void );
+		void			stopHostResolver( void );
+
+		friend struct	HostLookupAwaiter;
+#endif
+		Client			*getClient(const std::string &nickname) const;
+
+		//REGISTRATION
 		void			connectUser( Client* client, const ParseMessage& parsedMsg );
-		static	void	addNewUser(Client* client, const ParseMessage &parsedMsg);
-		Client			*getClient(std::string nickname);
+		void			completeRegistration( Client *client );
+		int				handleCapCommand( Client *client, const ParseMessage &parsedMsg );
+		int				handlePassCommand( Client *client, const ParseMessage &parsedMsg );
+		int				registerNick( Client *client, const ParseMessage &parsedMsg );
+		int				addNewUser( Client* client, const ParseMessage &parsedMsg );
+		void			loadWelcomeTemplate( void );
+		void			queueRegistration( Client *client );
+		void			admitRegistrations( long long now );
+		bool			admitNext( std::deque<ClientHandle> &queue );
+		std::size_t		pendingAdmissions( void ) const;
+
+		//SESSION RESUMPTION
+		void			issueResumeToken( Client *client );
+		bool			detachSession( Client *client );
+		int				resumeSession( Client *client, const ParseMessage &parsedMsg );
+		void			expireDetachedSessions( long long now );
 
 		// Commands
-		void			quitCommand(std::string reason, Client *client);
-		void			nickCommand(Client *client, const std::vector<std::string> &params);
-		void			processCommand( Client *client, const ParseMessage& parsedMsg);
+		CommandResult	quitCommand(const std::string &reason, Client *client);
+		void			nickCommand(Client *client, const ScratchVector<std::string> &params);
+		CommandResult	processCommand( Client *client, const ParseMessage& parsedMsg);
 		void 			joinCommand(Client *client, const ParseMessage& parsedMsg);
 		void 			privateMessage(Client *client, const ParseMessage &ParsedMsg);
 		void 			handelModeCommand(Client *client, const ParseMessage& parsedMsg);
@@ -69,29 +365,41 @@ class Server {
 		void 			motdCommand(Client *client);
 		void 			noticeCommand(Client *client, const ParseMessage& parsedMsg);
 
-		void			handleCapCommand(Client *client, const std::vector<std::string> &params);
-		bool 			handlePassCommand(Client *client, const std::vector<std::string> &params);
+		//SPAM FILTER
+		void			reloadSpamFilter(void);
+
+		//PRIORITY CLASSES
+		void			loadPriorityAddresses(void);
+		void			applyPriority(Client *client);
+		bool			filterMessage(Client *client, const std::string &target, std::string &text);
+
+		//METRICS
+		void			reportMetrics(long long now);
+		void			adjustCompressionLevel(long long elapsed);
+		void			measureMemory(MemoryUsage &usage) const;
 		
 
 	public:
 
 		//Channels
-		void 			addChannel(Channel &channel);
+		// frees the channel once its last member has left; any
+		// reference to it is dangling afterwards
+		bool			reapChannel(Channel &channel);
 		Channel&	getChannel(std::string channelName);
 		bool		isChannelInServer(std::string &channelName);
 		bool handleKeyMode(Client *client, Channel &channel, bool isAdding,
-	  std::vector<std::string> &params, std::size_t &paramIndex);
+	  ScratchVector<std::string> &params, std::size_t &paramIndex);
 		bool handleLimitMode(Client *client, Channel &channel, bool isAdding,
-	  std::vector<std::string> &params, std::size_t &paramIndex);
+	  ScratchVector<std::string> &params, std::size_t &paramIndex);
 		bool handleOperatorMode(Client *client, Channel &channel, bool isAdding,
-	  std::vector<std::string> &params, std::size_t &paramIndex);
+	  ScratchVector<std::string> &params, std::size_t &paramIndex);
 		bool processSingleChannelMode(Client *client, Channel &channel,
-	char mode, bool isAdding,   std::vector<std::string> &params,
+	char mode, bool isAdding,   ScratchVector<std::string> &params,
 	std::size_t &paramIndex);
 		void processChannelModes(Client *client, Channel &channel,
-	  std::vector<std::string> &params);
+	  ScratchVector<std::string> &params);
 		void handleChannelMode(Client *client, std::string &channelName,
-	  std::vector<std::string> &params);
+	  ScratchVector<std::string> &params);
 	  
 		std::string		greetJoinedUser(Client &client, Channel &channel);
 
@@ -101,17 +409,36 @@ class Server {
 		void 			initServer(void);
 		void 			runServer(void);
 		static void 			signalHandler(int signal);
+		static void 			reloadHandler(int signal);
 
 		void 			setServerPassword(const std::string& password) { _serverPassword = password; };
 		void 			setServerPort(int port) { _serverPort = port; };
 		std::string		getServerPassword( void );
 		bool			isValidIRCCommand(const std::string& command);
-		bool			isUserInServer(std::string nickname);
+		bool			isUserInServer(const std::string &nickname) const;
 		bool			isAlphanumeric(const std::string &str);
 };
 
-std::vector<std::string>  ft_split(std::string str, char delimiter);
+#ifdef IRC_COROUTINES
+// co_await HostLookupAwaiter(server, client) suspends the calling handler
+// until the client's address has been resolved to a hostname.
+struct HostLookupAwaiter {
+
+	Server			*server;
+	Client			*client;
+	std::string		result;
+
+	HostLookupAwaiter( Server *server, Client *client ) : server(server), client(client) {}
+
+	bool			await_ready( void ) const noexcept { return false; }
+	bool			await_suspend( std::coroutine_handle<> waiter );
+	std::string		await_resume( void ) { return result; }
+};
+#endif
+
+ScratchVector<std::string> ft_split(const std::string &str, char delimiter);
 std::vector<std::string> remove_spaces(std::string &str);
+long long ft_monotonicUsec(void);
 
 
 
@@ -0,0 +1,68 @@
+#pragma once
+#ifndef SPAMFILTER_HPP
+# define SPAMFILTER_HPP
+
+#include <string>
+#include <vector>
+
+# define SPAMFILTER_FILE "./SPAMFILTER.txt"
+# define SPAMFILTER_TAG "[spam] "
+
+// Multi-pattern matcher for PRIVMSG/NOTICE text.
+// Patterns are compiled into an Aho-Corasick automaton whose goto and
+// failure links are folded into one dense DFA over a compressed byte
+// alphabet, so scanning costs a single table lookup per byte. From the
+// root, bytes that cannot start a pattern are skipped sixteen at a time
+// with SSE2 or NEON, or one at a time through a table elsewhere.
+class SpamFilter {
+
+	public:
+
+		enum Action {
+			ACTION_NONE		= 0,
+			ACTION_LOG		= 1,
+			ACTION_TAG		= 2,
+			ACTION_BLOCK	= 4
+		};
+
+		SpamFilter( void );
+
+		bool				loadFromFile( const std::string &path );
+		bool				addPattern( const std::string &pattern, Action action );
+		void				compile( void );
+
+		int					scan( const std::string &text, std::string &matched ) const;
+
+		std::size_t			getPatternCount( void ) const { return _patterns.size(); }
+		static Action		parseAction( const std::string &name );
+
+	private:
+
+		// runs of start bytes the vector prefilter tests; a root with
+		// more than this falls back to the table
+		static const int			PREFILTER_RANGES = 8;
+
+		std::vector<std::string>	_patterns;
+		std::vector<int>			_actions;
+
+		// byte -> alphabet class, 0 means "not in any pattern"
+		unsigned char				_classOf[256];
+		// bytes that label an edge out of the root state
+		bool						_startByte[256];
+		// _startByte as runs [low, low + span], 0 runs when too many
+		unsigned char				_rangeLow[PREFILTER_RANGES];
+		unsigned char				_rangeSpan[PREFILTER_RANGES];
+		int							_rangeCount;
+		int							_classCount;
+
+		// dense transition table: _delta[state * _classCount + class]
+		std::vector<int>			_delta;
+		// OR of the actions of every pattern ending in this state
+		std::vector<int>			_output;
+		// one pattern ending in this state, reported in logs
+		std::vector<int>			_outputPattern;
+
+		std::size_t			skipToStart( const unsigned char *data, std::size_t i, std::size_t len ) const;
+};
+
+#endif /* SPAMFILTER_HPP */
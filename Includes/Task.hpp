@@ -0,0 +1,46 @@
+#pragma once
+#ifndef TASK_HPP
+# define TASK_HPP
+
+// Coroutine support is only compiled in the C++20 build (make coro).
+// Other builds run every handler synchronously to completion.
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+# define IRC_COROUTINES 1
+#endif
+
+#ifdef IRC_COROUTINES
+
+#include <coroutine>
+#include <exception>
+#include <iostream>
+
+// Fire-and-forget coroutine started from a command handler. It runs
+// eagerly up to its first co_await; from then on the event loop owns the
+// suspended handle and resumes it once the awaited operation completes.
+// The frame frees itself when the body finishes.
+class Task {
+
+	public:
+
+		struct promise_type {
+
+			Task					get_return_object( void ) { return Task(); }
+			std::suspend_never		initial_suspend( void ) noexcept { return std::suspend_never(); }
+			std::suspend_never		final_suspend( void ) noexcept { return std::suspend_never(); }
+			void					return_void( void ) {}
+			// An escaping exception ends the handler, not the server
+			void					unhandled_exception( void ) {
+				try {
+					throw;
+				} catch (const std::exception &e) {
+					std::cerr << "Handler failed: " << e.what() << std::endl;
+				} catch (...) {
+					std::cerr << "Handler failed" << std::endl;
+				}
+			}
+		};
+};
+
+#endif /* IRC_COROUTINES */
+
+#endif /* TASK_HPP */
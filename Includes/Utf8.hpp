@@ -0,0 +1,13 @@
+#pragma once
+#ifndef UTF8_HPP
+# define UTF8_HPP
+
+#include <string>
+
+// U+FFFD REPLACEMENT CHARACTER
+# define UTF8_REPLACEMENT "\xEF\xBF\xBD"
+
+bool		isValidUtf8( const std::string &text );
+std::string	sanitizeUtf8( const std::string &text );
+
+#endif /* UTF8_HPP */
@@ -0,0 +1,347 @@
+#include "../Includes/Server.hpp"
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+static std::string jsonEscape(const std::string &text)
+{
+    std::string escaped;
+
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+void Server::initAdminSocket(void) {
+    sockaddr_un address;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, ADMIN_SOCKET_PATH, sizeof(address.sun_path) - 1);
+
+    _adminSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_adminSocket == -1) {
+        perror("admin socket");
+        return;
+    }
+    // Only a stale socket file is removed, never one a running server
+    // still answers on
+    if (connect(_adminSocket, (struct sockaddr*)&address, sizeof(address)) == 0) {
+        std::cerr << "Admin socket " << ADMIN_SOCKET_PATH << " is in use by another server; admin socket disabled" << std::endl;
+        close(_adminSocket);
+        _adminSocket = -1;
+        return;
+    }
+    if (errno == ECONNREFUSED) {
+        unlink(ADMIN_SOCKET_PATH);
+    }
+    close(_adminSocket);
+    _adminSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    // The file is created owner-only by bind() itself, so there is no
+    // window in which another user could connect
+    mode_t previousMask = umask(0077);
+    bool bound = _adminSocket != -1
+        && fcntl(_adminSocket, F_SETFL, O_NONBLOCK) != -1
+        && bind(_adminSocket, (struct sockaddr*)&address, sizeof(address)) != -1;
+    umask(previousMask);
+    if (!bound || listen(_adminSocket, 4) == -1) {
+        perror("admin socket");
+        if (_adminSocket != -1) {
+            close(_adminSocket);
+        }
+        _adminSocket = -1;
+        return;
+    }
+
+    appendPollFd(_adminSocket, POLLIN);
+    _clients.setKind(_adminSocket, FD_ADMIN);
+    std::cout << "Admin socket listening on " << ADMIN_SOCKET_PATH << std::endl;
+}
+
+void Server::handleAdminEvent(pollfd &pfd) {
+    if (pfd.fd == _adminSocket) {
+        if (pfd.revents & POLLIN) {
+            int sessionFd = accept(_adminSocket, NULL, NULL);
+            if (sessionFd != -1) {
+                fcntl(sessionFd, F_SETFL, O_NONBLOCK);
+                _adminSessions[sessionFd] = AdminSession();
+                _clients.setKind(sessionFd, FD_ADMIN);
+                addPollFd(sessionFd, POLLIN);
+            }
+        }
+        return;
+    }
+
+    AdminSession &session = _adminSessions[pfd.fd];
+    // a peer that hung up with nothing left to read is never readable
+    // again, and would otherwise be reported on every poll()
+    if ((pfd.revents & (POLLHUP | POLLERR)) && !(pfd.revents & POLLIN)) {
+        closeAdminSession(pfd.fd);
+        return;
+    }
+    if (pfd.revents & POLLIN) {
+        char chunk[512];
+        ssize_t bytesRecv = recv(pfd.fd, chunk, sizeof(chunk), 0);
+        if (bytesRecv <= 0 || session.input.size() + bytesRecv > ADMIN_INPUT_MAX) {
+            closeAdminSession(pfd.fd);
+            return;
+        }
+        session.input.append(chunk, bytesRecv);
+    }
+
+    // One slice of any running dump, then queued commands once it is done;
+    // neither while the reader is behind on what it was already sent
+    if (session.output.size() < ADMIN_OUTPUT_MAX) {
+        advanceAdminDump(session);
+    }
+    std::size_t pos;
+    while (session.dump == AdminSession::DUMP_NONE && session.output.size() < ADMIN_OUTPUT_MAX
+           && (pos = session.input.find('\n')) != std::string::npos) {
+        std::string line = session.input.substr(0, pos);
+        session.input.erase(0, pos + 1);
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.erase(line.size() - 1);
+        }
+        runAdminCommand(session, line);
+        advanceAdminDump(session);
+    }
+
+    if ((pfd.revents & POLLOUT) && !session.output.empty()) {
+        ssize_t bytesSent = send(pfd.fd, session.output.data(), session.output.size(), MSG_NOSIGNAL);
+        if (bytesSent > 0) {
+            session.output.erase(0, bytesSent);
+        }
+    }
+    // POLLOUT while there is output or a dump to advance, not otherwise;
+    // no POLLIN while output is backed up, so new commands wait in the
+    // socket instead of in session.input
+    bool writing = !session.output.empty() || session.dump != AdminSession::DUMP_NONE;
+    bool reading = session.output.size() < ADMIN_OUTPUT_MAX;
+    pfd.events = (reading ? POLLIN : 0) | (writing ? POLLOUT : 0);
+}
+
+void Server::closeAdminSession(int fd) {
+    _adminSessions.erase(fd);
+    _clients.setKind(fd, FD_FREE);
+    close(fd);
+    releasePollFd(fd);
+}
+
+void Server::runAdminCommand(AdminSession &session, const std::string &line) {
+    std::istringstream iss(line);
+    std::string command;
+    std::string argument;
+
+    iss >> command >> argument;
+    if (command == "clients") {
+        session.dump = AdminSession::DUMP_CLIENTS;
+        session.clientCursor = -1;
+        session.firstEntry = true;
+        session.output += "{\"clients\":[";
+    } else if (command == "channels") {
+        session.dump = AdminSession::DUMP_CHANNELS;
+        session.channelCursor = -1;
+        session.firstEntry = true;
+        session.output += "{\"channels\":[";
+    } else if (command == "channel") {
+        if (!isChannelInServer(argument)) {
+            session.output += "{\"error\":\"no such channel\"}\n";
+            return;
+        }
+        session.output += adminChannelJson(getChannel(argument)) + "\n";
+    } else if (command == "stats") {
+        session.output += adminStatsJson() + "\n";
+    } else if (command == "fanout") {
+        session.output += adminFanoutJson() + "\n";
+        if (argument == "reset") {
+            Channel::fanout = FanoutStats();
+            OutputBuffer::resetCreated();
+        }
+    } else if (command == "memory") {
+        session.output += adminMemoryJson() + "\n";
+    } else if (command == "kill") {
+        if (adminDisconnect(argument)) {
+            session.output += "{\"ok\":true}\n";
+        } else {
+            session.output += "{\"error\":\"no such client\"}\n";
+        }
+    } else {
+        session.output += "{\"error\":\"unknown command\",\"commands\":"
+                          "[\"clients\",\"channels\",\"channel <name>\",\"stats\",\"fanout [reset]\",\"memory\",\"kill <fd|nick>\"]}\n";
+    }
+}
+
+void Server::advanceAdminDump(AdminSession &session) {
+    int emitted = 0;
+
+    if (session.dump == AdminSession::DUMP_CLIENTS) {
+        long now = time(NULL);
+        int fd = _clients.next(session.clientCursor);
+        for (; fd != -1 && emitted < ADMIN_SLICE; fd = _clients.next(fd), ++emitted) {
+            session.output += session.firstEntry ? "" : ",";
+            session.output += adminClientJson(_clients.find(fd), now);
+            session.firstEntry = false;
+            session.clientCursor = fd;
+        }
+        if (fd == -1) {
+            session.output += "]}\n";
+            session.dump = AdminSession::DUMP_NONE;
+        }
+    } else if (session.dump == AdminSession::DUMP_CHANNELS) {
+        int id = _channels.next(session.channelCursor);
+        for (; id != -1 && emitted < ADMIN_SLICE; id = _channels.next(id), ++emitted) {
+            session.output += session.firstEntry ? "" : ",";
+            session.output += adminChannelJson(_channels.at(id));
+            session.firstEntry = false;
+            session.channelCursor = id;
+        }
+        if (id == -1) {
+            session.output += "]}\n";
+            session.dump = AdminSession::DUMP_NONE;
+        }
+    }
+}
+
+std::string Server::adminClientJson(Client *client, long now) const {
+    const DeflateStream *stream = client->getDeflateStream();
+    unsigned long rawBytes = stream ? stream->getRawBytes() : 0;
+    unsigned long compressedBytes = stream ? stream->getCompressedBytes() : 0;
+    std::ostringstream oss;
+    oss << "{\"fd\":" << client->getFd()
+        << ",\"nick\":\"" << jsonEscape(client->getNickname()) << "\""
+        << ",\"user\":\"" << jsonEscape(client->getUsername()) << "\""
+        << ",\"registered\":" << (client->isFullyRegistered() ? "true" : "false")
+        << ",\"hibernating\":" << (client->isHibernating() ? "true" : "false")
+        << ",\"priority\":\"" << (client->getPriority() == PRIORITY_HIGH ? "high" : "normal") << "\""
+        << ",\"input_bytes\":" << client->getBuffer().size()
+        << ",\"queued_replies\":" << client->serverReplies.size()
+        << ",\"queued_bytes\":" << client->serverReplies.bytes()
+        << ",\"output_bytes\":" << client->getOutBuffer().size()
+        << ",\"compress_raw\":" << rawBytes
+        << ",\"compress_out\":" << compressedBytes
+        << ",\"compress_ratio\":" << (compressedBytes > 0 ? static_cast<double>(rawBytes) / compressedBytes : 0.0)
+        << ",\"compress_cpu_us\":" << (stream ? stream->getCpuMicros() : 0)
+        << ",\"idle_seconds\":" << (now - client->getLastActivity()) << "}";
+    return oss.str();
+}
+
+std::string Server::adminChannelJson(const Channel &channel) const {
+    std::ostringstream oss;
+    const std::map<std::string, Client *> &users = channel.getUsers();
+
+    oss << "{\"name\":\"" << jsonEscape(channel.getChannelName()) << "\""
+        << ",\"modes\":\"" << channel.getModes() << "\""
+        << ",\"topic\":\"" << jsonEscape(channel.getTopic()) << "\""
+        << ",\"limit\":" << channel.getUserLimit()
+        << ",\"member_count\":" << users.size()
+        << ",\"members\":[";
+    for (std::map<std::string, Client *>::const_iterator it = users.begin(); it != users.end(); ++it) {
+        oss << (it == users.begin() ? "" : ",")
+            << "{\"nick\":\"" << jsonEscape(it->first) << "\""
+            << ",\"operator\":" << (channel.isOperator(it->first) ? "true" : "false") << "}";
+    }
+    oss << "]}";
+    return oss.str();
+}
+
+std::string Server::adminStatsJson(void) const {
+    std::ostringstream oss;
+
+    oss << "{\"clients\":" << _clients.size()
+        << ",\"channels\":" << _channels.size()
+        << ",\"nicknames\":" << _nicknames.size()
+        << ",\"pollfds\":" << _fds.size()
+        << ",\"fd_limit\":" << _descriptorLimit
+        << ",\"rejected_connections\":" << _rejectedConnections
+        << ",\"ready_clients\":" << _readyClients.size()
+        << ",\"budget_deferrals\":" << _budgetDeferrals
+        << ",\"hibernating_clients\":" << Client::hibernatingTotal()
+        << ",\"hibernations\":" << _hibernations
+        << ",\"reclaimed_bytes\":" << _reclaimedBytes
+        << ",\"iterations\":" << _iterations
+        << ",\"busy_us_since_metrics\":" << _busyMicros
+        << ",\"overload_level\":" << _overloadLevel
+        << ",\"queued_bytes\":" << _queuedBytes
+        << ",\"deferred_registrations\":" << _deferredRegistrations.size()
+        << ",\"shed_messages\":" << _shedMessages
+        << ",\"welcomes\":" << _welcomes
+        << ",\"welcome_avg_us\":" << (_welcomes > 0 ? _welcomeMicros / static_cast<long long>(_welcomes) : 0)
+        << ",\"welcome_max_us\":" << _welcomeWorst
+        << ",\"detached_sessions\":" << _detachedSessions.size()
+        << ",\"resumes\":" << _resumes
+        << ",\"resumes_expired\":" << _resumesExpired
+        << ",\"admission_queue\":" << _admissionQueue.size()
+        << ",\"admission_priority\":" << _priorityAdmissions.size()
+        << ",\"admitted\":" << _admitted
+        << ",\"admitted_priority\":" << _admittedPriority
+        << ",\"compression_level\":" << _compressionLevel
+        << ",\"copy_sends\":" << _copySends
+        << ",\"zerocopy_sends\":" << _zeroCopySends
+        << ",\"spam_patterns\":" << (_spamFilter ? _spamFilter->getPatternCount() : 0) << "}";
+    return oss.str();
+}
+
+// Broadcast totals; buffers_created also counts replies too large for a
+// pooled chunk
+std::string Server::adminFanoutJson(void) const {
+    std::ostringstream oss;
+
+    oss << "{\"fanout\":{\"broadcasts\":" << Channel::fanout.broadcasts
+        << ",\"recipients\":" << Channel::fanout.recipients
+        << ",\"bytes\":" << Channel::fanout.bytes
+        << ",\"buffers_created\":" << OutputBuffer::created() << "}}";
+    return oss.str();
+}
+
+// Heap by subsystem, with the high-water mark of each since startup
+std::string Server::adminMemoryJson(void) const {
+    std::ostringstream oss;
+    MemoryUsage usage;
+    struct rusage rusage;
+
+    measureMemory(usage);
+    MemoryAccount::record(usage);
+    getrusage(RUSAGE_SELF, &rusage);
+    oss << "{\"rss_bytes\":" << MemoryAccount::residentBytes()
+        << ",\"max_rss_kb\":" << rusage.ru_maxrss
+        << ",\"accounted_bytes\":" << usage.total()
+        << ",\"subsystems\":{";
+    for (int tag = 0; tag < MEM_TAGS; ++tag) {
+        oss << (tag == 0 ? "" : ",")
+            << "\"" << MemoryAccount::tagName(tag) << "\":{\"bytes\":" << usage.bytes[tag]
+            << ",\"peak\":" << MemoryAccount::peak(static_cast<MemoryTag>(tag)) << "}";
+    }
+    oss << "}}";
+    return oss.str();
+}
+
+bool Server::adminDisconnect(const std::string &target) {
+    Client *client = NULL;
+
+    if (!target.empty() && target.find_first_not_of("0123456789") == std::string::npos) {
+        client = _clients.find(std::atoi(target.c_str()));
+    } else {
+        client = getClient(target);
+    }
+    if (client == NULL || client->getFd() == -1) {
+        return false;
+    }
+
+    client->serverReplies.push_back(RPL_ERROR(std::string(":localhost"), std::string("Closing link: killed by server admin")));
+    sendToClient(client->getFd());
+    // closed with the iteration's other departures, like a QUIT
+    scheduleClose(client, "Killed by server admin", false);
+    return true;
+}
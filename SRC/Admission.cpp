@@ -0,0 +1,77 @@
+#include "../Includes/Server.hpp"
+
+// A client that has completed CAP/PASS/NICK/USER waits here, suspended,
+// until the admission pacer lets its welcome through. Known addresses and
+// resumed sessions go to the priority queue.
+void Server::queueRegistration(Client *client) {
+    bool priority = client->isResumed()
+        || (REGISTRATION_PRIORITY && _knownAddresses.count(client->getAddress().sin_addr.s_addr));
+
+    client->setSuspended(true);
+    if (priority) {
+        _priorityAdmissions.push_back(client->getHandle());
+    } else {
+        _admissionQueue.push_back(client->getHandle());
+    }
+}
+
+void Server::admitRegistrations(long long now) {
+    long long elapsed = now - _lastAdmission;
+
+    _lastAdmission = now;
+    _admissionCredit += static_cast<double>(elapsed) * REGISTRATION_RATE / 1000000.0;
+    if (_admissionCredit > REGISTRATION_BURST) {
+        _admissionCredit = REGISTRATION_BURST;
+    }
+    if (_overloadLevel >= LOAD_DEFER_REGISTRATION) {
+        return;
+    }
+
+    // Priority entries get PRIORITY_SHARE of every PRIORITY_SHARE + 1
+    // admissions, so a stream of known addresses cannot starve new ones
+    while (_admissionCredit >= 1.0 && (!_priorityAdmissions.empty() || !_admissionQueue.empty())) {
+        bool admitted;
+        if (!_priorityAdmissions.empty() && (_prioritySlots < PRIORITY_SHARE || _admissionQueue.empty())) {
+            admitted = admitNext(_priorityAdmissions);
+            ++_prioritySlots;
+            _admittedPriority += admitted;
+        } else {
+            admitted = admitNext(_admissionQueue);
+            _prioritySlots = 0;
+        }
+        if (admitted) {
+            _admissionCredit -= 1.0;
+            ++_admitted;
+        }
+    }
+}
+
+bool Server::admitNext(std::deque<ClientHandle> &queue) {
+    while (!queue.empty()) {
+        ClientHandle handle = queue.front();
+        queue.pop_front();
+
+        Client *client = resolveClient(handle);
+        if (client == NULL || client->getRegistration() != (REG_COMPLETE & ~REG_ADMITTED)) {
+            continue;
+        }
+
+        client->addRegistration(REG_ADMITTED);
+        client->setSuspended(false);
+        if (_knownAddresses.size() < KNOWN_ADDRESSES_MAX) {
+            _knownAddresses.insert(client->getAddress().sin_addr.s_addr);
+        }
+#ifdef IRC_COROUTINES
+        welcomeUser(client);
+#else
+        completeRegistration(client);
+#endif
+        processBufferedLines(client);
+        return true;
+    }
+    return false;
+}
+
+std::size_t Server::pendingAdmissions(void) const {
+    return _admissionQueue.size() + _priorityAdmissions.size();
+}
@@ -0,0 +1,227 @@
+#include "../Includes/Server.hpp"
+
+#ifdef IRC_COROUTINES
+
+HostResolver::HostResolver(void) : _stopping(false) {
+    _pipe[0] = -1;
+    _pipe[1] = -1;
+}
+
+HostResolver::~HostResolver(void) {
+    stop();
+}
+
+bool HostResolver::start(std::size_t workers) {
+    sigset_t all;
+    sigset_t previous;
+    bool started = true;
+
+    if (pipe(_pipe) == -1) {
+        return false;
+    }
+    fcntl(_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(_pipe[1], F_SETFL, O_NONBLOCK);
+    // Workers inherit a blocked mask, so SIGINT and SIGHUP always land on
+    // the event loop thread and interrupt its poll()
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+    try {
+        for (std::size_t i = 0; i < workers; ++i) {
+            _workers.push_back(std::thread(&HostResolver::work, this));
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Can't start host resolver (" << e.what() << ")" << std::endl;
+        started = false;
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (!started) {
+        stop();
+    }
+    return started;
+}
+
+void HostResolver::stop(void) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    for (std::size_t i = 0; i < _workers.size(); ++i) {
+        _workers[i].join();
+    }
+    _workers.clear();
+    for (std::size_t i = 0; i < _queue.size(); ++i) {
+        delete _queue[i];
+    }
+    for (std::size_t i = 0; i < _done.size(); ++i) {
+        delete _done[i];
+    }
+    _queue.clear();
+    _done.clear();
+    for (int i = 0; i < 2; ++i) {
+        if (_pipe[i] != -1) {
+            close(_pipe[i]);
+            _pipe[i] = -1;
+        }
+    }
+}
+
+void HostResolver::submit(HostLookup *lookup) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(lookup);
+    }
+    _wake.notify_one();
+}
+
+void HostResolver::collect(std::vector<HostLookup *> &done) {
+    char drain[64];
+
+    // Drained before taking the list: a lookup finishing in between
+    // leaves a byte behind and costs one empty wakeup, never a lost one
+    while (read(_pipe[0], drain, sizeof(drain)) > 0) {
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    done.swap(_done);
+}
+
+void HostResolver::work(void) {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (true) {
+        _wake.wait(lock, [this] { return _stopping || !_queue.empty(); });
+        if (_stopping) {
+            return;
+        }
+        HostLookup *lookup = _queue.front();
+        _queue.pop_front();
+        lock.unlock();
+
+        if (getnameinfo(reinterpret_cast<sockaddr *>(&lookup->address), sizeof(lookup->address),
+                        lookup->host, NI_MAXHOST, NULL, 0, 0) != 0) {
+            inet_ntop(AF_INET, &lookup->address.sin_addr, lookup->host, NI_MAXHOST);
+        }
+
+        lock.lock();
+        _done.push_back(lookup);
+        // one byte per batch: the loop takes every finished lookup at once
+        if (_done.size() == 1 && write(_pipe[1], "", 1) == -1 && errno != EAGAIN) {
+            std::cerr << "Host resolver wakeup failed: " << strerror(errno) << std::endl;
+        }
+    }
+}
+
+bool HostLookupAwaiter::await_suspend(std::coroutine_handle<> waiter)
+{
+    if (server->startHostLookup(client, waiter, &result)) {
+        client->setSuspended(true);
+        return true;
+    }
+    char host[NI_MAXHOST];
+    inet_ntop(AF_INET, &client->getAddress().sin_addr, host, NI_MAXHOST);
+    result = host;
+    return false;
+}
+
+Task Server::welcomeUser(Client *client)
+{
+    std::string hostname = co_await HostLookupAwaiter(this, client);
+
+    client->setHostname(hostname);
+    std::cout << "User " << client->getNickname() << " resolved to " << hostname << std::endl;
+    completeRegistration(client);
+}
+
+bool Server::startHostLookup(Client *client, std::coroutine_handle<> waiter, std::string *result)
+{
+    if (_resolver.getWakeFd() == -1) {
+        return false;
+    }
+
+    HostLookup *lookup = new HostLookup();
+    lookup->address = client->getAddress();
+    lookup->host[0] = '\0';
+    lookup->client = client->getHandle();
+    lookup->waiter = waiter;
+    lookup->result = result;
+    _lookups[client->getFd()] = lookup;
+    _resolver.submit(lookup);
+    return true;
+}
+
+void Server::startHostResolver(void)
+{
+    if (!_resolver.start(RESOLVER_THREADS)) {
+        std::cerr << "Host lookups disabled; clients keep their numeric address" << std::endl;
+        return;
+    }
+    _clients.setKind(_resolver.getWakeFd(), FD_LOOKUP);
+    appendPollFd(_resolver.getWakeFd(), POLLIN);
+}
+
+void Server::stopHostResolver(void)
+{
+    if (_resolver.getWakeFd() != -1) {
+        _clients.setKind(_resolver.getWakeFd(), FD_FREE);
+        releasePollFd(_resolver.getWakeFd());
+    }
+    for (std::map<int, HostLookup *>::iterator it = _lookups.begin(); it != _lookups.end(); ++it) {
+        it->second->waiter.destroy();
+        it->second->waiter = std::coroutine_handle<>();
+    }
+    _lookups.clear();
+    _resolver.stop();
+}
+#endif
+
+void Server::completeHostLookup(pollfd &pfd)
+{
+#ifdef IRC_COROUTINES
+    std::vector<HostLookup *> done;
+
+    if (!(pfd.revents & POLLIN)) {
+        return;
+    }
+    _resolver.collect(done);
+    for (std::size_t i = 0; i < done.size(); ++i) {
+        HostLookup *lookup = done[i];
+        if (!lookup->waiter) {
+            // the client left while its lookup was still running
+            delete lookup;
+            continue;
+        }
+        _lookups.erase(lookup->client.fd);
+        *lookup->result = lookup->host;
+        std::coroutine_handle<> waiter = lookup->waiter;
+        ClientHandle handle = lookup->client;
+        delete lookup;
+
+        Client *client = resolveClient(handle);
+        if (client == NULL) {
+            waiter.destroy();
+            continue;
+        }
+        client->setSuspended(false);
+        waiter.resume();
+
+        processBufferedLines(client);
+    }
+#else
+    (void)pfd;
+#endif
+}
+
+void Server::cancelClientTasks(int client_fd)
+{
+#ifdef IRC_COROUTINES
+    std::map<int, HostLookup *>::iterator found = _lookups.find(client_fd);
+
+    if (found != _lookups.end()) {
+        found->second->waiter.destroy();
+        found->second->waiter = std::coroutine_handle<>();
+        _lookups.erase(found);
+    }
+#else
+    (void)client_fd;
+#endif
+}
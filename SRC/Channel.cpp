@@ -1,10 +1,11 @@
 #include "../Includes/Server.hpp"
 #include "../Includes/Channel.hpp"
 
-Channel::Channel(std::string &channelName, Client *client) : channelName(channelName), UserLimit(0)
+Channel::Channel(const std::string &channelName, Client *client) : channelName(channelName), UserLimit(0), _slot(-1)
 {
     operators[client->getNickname()] = client;
     users[client->getNickname()] = client;
+    client->addMembership(channelName);
     modes['i'] = false;
     modes['t'] = false;
     modes['k'] = false;
@@ -17,26 +18,22 @@ Channel::~Channel(){}
 
 Channel &Server::getChannel(std::string channelName)
 {
-    std::map<std::string, Channel>::iterator chan = _channels.find(channelName);
-    return chan->second;
+    return *_channels.find(channelName);
 }
 
 bool Server::isChannelInServer(std::string &channelName)
 {
-    std::map<std::string, Channel>::iterator chan = _channels.find(channelName);
-    if(chan != _channels.end())
-    {
-        return (true);
-    }
-    return (false);
+    return _channels.find(channelName) != NULL;
 }
 
 void Channel::addClient(Client *client)
 {
     std::string nick = client->getNickname();
     users[nick] = client;
+    client->addMembership(channelName);
     if(isInvited(nick))
     {
+        inviteList[nick]->removeInvite(channelName);
         inviteList.erase(nick);
     }
     if(operators.size() == 0)
@@ -70,7 +67,7 @@ bool Channel::isInvited(std::string nickname)
     return false;
 }
 
-std::map<std::string, Client *> Channel::getUsers( void ) const
+const std::map<std::string, Client *> &Channel::getUsers( void ) const
 {
     return this->users;
 }
@@ -84,7 +81,7 @@ bool Channel::checkMode(char c)
     return false;
 }
 
-bool Channel::isOperator(std::string &nickname)
+bool Channel::isOperator(const std::string &nickname) const
 {
     if(this->operators.find(nickname) != operators.end())
     {
@@ -97,6 +94,7 @@ void Channel::inviteClient(Client *client)
 {
     std::string nick = client->getNickname();
     this->inviteList[nick] = client;
+    client->addInvite(channelName);
 }
 
 void Channel::setKey(std::string &password)
@@ -127,28 +125,48 @@ std::map<char, bool> Channel::getModesMap( void ) const
     return modes;
 }
 
-void Channel::broadcastMessage(const std::string message)
+FanoutStats Channel::fanout = FanoutStats();
+
+void Channel::recordFanout(std::size_t length, std::size_t recipients) const
 {
+    ++fanout.broadcasts;
+    fanout.recipients += recipients;
+    fanout.bytes += recipients * length;
+}
+
+void Channel::broadcastMessage(const std::string &message)
+{
+    std::size_t recipients = 0;
+    // one copy of the line, referenced from every recipient's queue
+    OutputBuffer *line = OutputBuffer::create(message);
     std::map<std::string, Client *>::iterator it;
     for (it = users.begin(); it != users.end(); ++it)
     {
-        if (it->second->getFd() != -1)
+        if (it->second->isReachable())
         {
-            it->second->serverReplies.push_back(message);
+            it->second->serverReplies.pushShared(line);
+            ++recipients;
         }
     }
+    line->release();
+    recordFanout(message.size(), recipients);
 }
 
-void Channel::sendToOthers(Client *client, std::string message)
+void Channel::sendToOthers(Client *client, const std::string &message)
 {
+    std::size_t recipients = 0;
+    OutputBuffer *line = OutputBuffer::create(message);
     std::map<std::string, Client *>::iterator it;
     for (it = users.begin(); it != users.end(); ++it)
     {
-        if (it->second->getFd() != -1 && it->second != client)
+        if (it->second->isReachable() && it->second != client)
         {
-            it->second->serverReplies.push_back(message);
+            it->second->serverReplies.pushShared(line);
+            ++recipients;
         }
     }
+    line->release();
+    recordFanout(message.size(), recipients);
 }
 
 bool Channel::setMode(char c, bool setting)
@@ -231,11 +249,12 @@ std::string Channel::getTopic() const
     return _topic;
 }
 
-void Channel::removeInvite(std::string &invite)
+void Channel::removeInvite(const std::string &invite)
 {
     std::map<std::string, Client*>::iterator invite_itr = this->inviteList.find(invite);
     if (invite_itr != this->inviteList.end())
     {
+        invite_itr->second->removeInvite(channelName);
         this->inviteList.erase(invite_itr);
     }
 }
@@ -247,7 +266,35 @@ void Channel::removeClient(Client *client)
     if (users_itr != this->users.end())
     {
         this->users.erase(users_itr);
+        client->removeMembership(channelName);
+    }
+}
+
+void Channel::releaseInvites()
+{
+    std::map<std::string, Client *>::iterator it;
+    for (it = inviteList.begin(); it != inviteList.end(); ++it)
+    {
+        it->second->removeInvite(channelName);
     }
+    inviteList.clear();
+}
+
+// The channel's slot and index entry are charged by the ChannelTable
+std::size_t Channel::heapBytes() const
+{
+    const std::map<std::string, Client *> *lists[] = { &operators, &users, &inviteList };
+    std::size_t bytes = MemoryAccount::string(channelName) + MemoryAccount::string(_topic)
+                        + MemoryAccount::string(_key)
+                        + modes.size() * MemoryAccount::treeNode(sizeof(std::pair<const char, bool>));
+
+    for (std::size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); ++i)
+    {
+        std::map<std::string, Client *>::const_iterator it;
+        for (it = lists[i]->begin(); it != lists[i]->end(); ++it)
+            bytes += MemoryAccount::treeNode(sizeof(*it)) + MemoryAccount::string(it->first);
+    }
+    return bytes;
 }
 
 std::string ft_trim(std::string text)
@@ -261,11 +308,6 @@ std::string ft_trim(std::string text)
     return text.substr(first, (last - first + 1));
 }
 
-void Server::addChannel(Channel &channel)
-{
-    _channels.insert(std::make_pair(channel.getChannelName(), channel));
-}
-
 std::string Server::greetJoinedUser(Client &client, Channel &channel)
 {
     std::string reply;
@@ -283,7 +325,7 @@ std::string Server::greetJoinedUser(Client &client, Channel &channel)
 std::string Channel::getUsersList()
 {
     std::string memberList;
-    std::map<std::string, Client *> users = this->getUsers();
+    const std::map<std::string, Client *> &users = this->getUsers();
     for (std::map<std::string, Client*>::const_iterator iter = users.begin(); iter != users.end(); ++iter) {
         const Client* currentMember = iter->second;
         if (isOperator(currentMember->getNickname())) {
@@ -319,6 +361,22 @@ void Channel::updateNickname(std::string oldNick, std::string newNick)
     }
 }
 
+void Channel::replaceClient(Client *from, Client *to)
+{
+    std::map<std::string, Client *> *lists[] = { &users, &operators, &inviteList };
+
+    for (std::size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); ++i)
+    {
+        std::map<std::string, Client *>::iterator it = lists[i]->find(from->getNickname());
+        if (it != lists[i]->end() && it->second == from)
+            it->second = to;
+    }
+    if (users.count(to->getNickname()))
+        to->addMembership(channelName);
+    if (inviteList.count(to->getNickname()))
+        to->addInvite(channelName);
+}
+
 std::map<std::string, Client *> operators;
 std::map<std::string, Client *> users;
 std::map<std::string, Client *> inviteList;
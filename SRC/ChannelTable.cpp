@@ -0,0 +1,98 @@
+#include "../Includes/ChannelTable.hpp"
+#include "../Includes/MemoryStats.hpp"
+#include <new>
+
+ChannelTable::ChannelTable(void) : _count(0) {
+    return;
+}
+
+ChannelTable::~ChannelTable(void) {
+    clear();
+    for (std::size_t i = 0; i < _blocks.size(); ++i) {
+        ::operator delete(_blocks[i]);
+    }
+    return;
+}
+
+std::string ChannelTable::fold(const std::string &name) {
+    std::string folded(name);
+
+    for (std::size_t i = 0; i < folded.size(); ++i) {
+        if (folded[i] >= 'A' && folded[i] <= 'Z') {
+            folded[i] = folded[i] - 'A' + 'a';
+        }
+    }
+    return folded;
+}
+
+Channel *ChannelTable::slot(int id) const {
+    return _blocks[id / BLOCK_SIZE] + id % BLOCK_SIZE;
+}
+
+Channel *ChannelTable::find(const std::string &name) const {
+    std::unordered_map<std::string, int>::const_iterator it = _index.find(fold(name));
+
+    if (it == _index.end()) {
+        return NULL;
+    }
+    return slot(it->second);
+}
+
+Channel &ChannelTable::create(const std::string &name, Client *creator) {
+    if (_free.empty()) {
+        int first = static_cast<int>(_live.size());
+        _blocks.push_back(static_cast<Channel *>(::operator new(BLOCK_SIZE * sizeof(Channel))));
+        _live.resize(_live.size() + BLOCK_SIZE, 0);
+        for (int id = first + BLOCK_SIZE - 1; id >= first; --id) {
+            _free.push_back(id);
+        }
+    }
+    int id = _free.back();
+    _free.pop_back();
+
+    Channel *channel = new (slot(id)) Channel(name, creator);
+    channel->setSlot(id);
+    _live[id] = 1;
+    _index[fold(name)] = id;
+    ++_count;
+    return *channel;
+}
+
+void ChannelTable::erase(Channel &channel) {
+    int id = channel.getSlot();
+
+    _index.erase(fold(channel.getChannelName()));
+    channel.~Channel();
+    _live[id] = 0;
+    _free.push_back(id);
+    --_count;
+}
+
+void ChannelTable::clear(void) {
+    for (int id = next(-1); id != -1; id = next(id)) {
+        erase(at(id));
+    }
+}
+
+int ChannelTable::next(int id) const {
+    for (std::size_t i = id + 1; i < _live.size(); ++i) {
+        if (_live[i]) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+std::size_t ChannelTable::heapBytes(void) const {
+    std::size_t bytes = _blocks.size() * MemoryAccount::block(BLOCK_SIZE * sizeof(Channel))
+                        + MemoryAccount::block(_blocks.capacity() * sizeof(Channel *))
+                        + MemoryAccount::block(_live.capacity())
+                        + MemoryAccount::block(_free.capacity() * sizeof(int))
+                        + _index.bucket_count() * sizeof(void *);
+
+    for (std::unordered_map<std::string, int>::const_iterator it = _index.begin(); it != _index.end(); ++it) {
+        bytes += MemoryAccount::block(sizeof(void *) + sizeof(*it) + sizeof(std::size_t))
+                 + MemoryAccount::string(it->first);
+    }
+    return bytes;
+}
@@ -1,22 +1,83 @@
 #include "../Includes/Server.hpp"
 
+unsigned long Client::_nextGeneration = 0;
+std::size_t Client::_outBufferTotal = 0;
+Client *Client::_idleHead = NULL;
+Client *Client::_idleTail = NULL;
+std::size_t Client::_hibernatingTotal = 0;
+
 Client::Client(void) : _fd(0),
+                      _registration(0),
+                      _suspended(false),
+                      _ready(false),
+                      _closing(false),
+                      _priority(PRIORITY_NORMAL),
+                      _detached(false),
                       _isCorrectPassword(false),
-                      _nickname(""),
-                      _username(""),
-                      _channel("") {
-    memset(conRegi, 0, 3);
-    isRegistered = false;
+                      _resumeRequested(false),
+                      _resumed(false),
+                      _hibernating(false),
+                      _nickLength(0),
+                      _lastActivity(time(NULL)),
+                      _idlePrev(NULL),
+                      _idleNext(NULL),
+                      _generation(++_nextGeneration),
+                      _deflate(NULL),
+                      _compressionPending(false),
+                      _compressionStart(0),
+                      _zeroCopy(false),
+                      _zeroCopySeq(0),
+                      _zeroCopyPinned(NULL),
+                      _identity(new ClientIdentity()) {
+    _nickname[0] = '\0';
+    serverReplies.setOwner(this);
+    memset(&_identity->address, 0, sizeof(_identity->address));
+    _identity->connectedAt = ft_monotonicUsec();
     return;
 }
 
 Client::Client(int fd) : _fd(fd),
+                        _registration(0),
+                        _suspended(false),
+                        _ready(false),
+                        _closing(false),
+                        _priority(PRIORITY_NORMAL),
+                        _detached(false),
                         _isCorrectPassword(false),
-                        _nickname(""),
-                        _username(""),
-                        _channel("") {
-    memset(conRegi, 0, 3);
-    isRegistered = false;
+                        _resumeRequested(false),
+                        _resumed(false),
+                        _hibernating(false),
+                        _nickLength(0),
+                        _lastActivity(time(NULL)),
+                        _idlePrev(NULL),
+                        _idleNext(NULL),
+                        _generation(++_nextGeneration),
+                          _deflate(NULL),
+                        _compressionPending(false),
+                        _compressionStart(0),
+                        _zeroCopy(false),
+                        _zeroCopySeq(0),
+                        _zeroCopyPinned(NULL),
+                        _identity(new ClientIdentity()) {
+    _nickname[0] = '\0';
+    serverReplies.setOwner(this);
+    memset(&_identity->address, 0, sizeof(_identity->address));
+    _identity->connectedAt = ft_monotonicUsec();
+    linkIdle();
+    return;
+}
+
+Client::~Client(void) {
+    _outBufferTotal -= _outBuffer.size();
+    unlinkIdle();
+    if (_hibernating) {
+        --_hibernatingTotal;
+    }
+    delete _deflate;
+    if (_zeroCopyPinned != NULL) {
+        releasePinned(0, ~0u);
+    }
+    delete _identity;
     return;
 }
 
@@ -32,22 +93,157 @@ void Client::setIsCorrectPassword(bool isCorrectPassword) {
     return;
 }
 
+// Callers validate the length; anything past NICKLEN is cut off here
 void Client::setNickname(const std::string &nickname) {
-    _nickname = nickname;
+    _nickLength = static_cast<unsigned char>(std::min<std::size_t>(nickname.size(), NICKLEN));
+    memcpy(_nickname, nickname.data(), _nickLength);
+    _nickname[_nickLength] = '\0';
     return;
 }
 
 void Client::setUsername(const std::string &username) {
-    _username = username;
+    _identity->username = username;
+    return;
+}
+
+std::string Client::getNickname(void) const {
+    return std::string(_nickname, _nickLength);
+}
+
+bool Client::hasNickname(const std::string &nickname) const {
+    return nickname.size() == _nickLength && memcmp(nickname.data(), _nickname, _nickLength) == 0;
+}
+
+const std::string &Client::getUsername(void) const {
+    return _identity->username;
+}
+
+void Client::setHostname(const std::string &hostname) {
+    _identity->hostname = hostname;
+    return;
+}
+
+std::string Client::getHostname(void) const {
+    return _identity->hostname;
+}
+
+void Client::setAddress(const sockaddr_in &address) {
+    _identity->address = address;
+    return;
+}
+
+const sockaddr_in &Client::getAddress(void) const {
+    return _identity->address;
+}
+
+void Client::setSuspended(bool suspended) {
+    _suspended = suspended;
     return;
 }
 
-std::string &Client::getNickname(void) const {
-    return const_cast<std::string &>(_nickname);
+bool Client::isSuspended(void) const {
+    return _suspended;
+}
+
+void Client::setReady(bool ready) {
+    _ready = ready;
+}
+
+bool Client::isReady(void) const {
+    return _ready;
+}
+
+void Client::setClosing(void) {
+    _closing = true;
+}
+
+bool Client::isClosing(void) const {
+    return _closing;
 }
 
-std::string Client::getUsername(void) const {
-    return _username;
+void Client::setPriority(ClientPriority priority) {
+    _priority = static_cast<unsigned char>(priority);
+}
+
+ClientPriority Client::getPriority(void) const {
+    return static_cast<ClientPriority>(_priority);
+}
+
+bool Client::hasPendingOutput(void) const {
+    return !serverReplies.empty() || !_outBuffer.empty();
+}
+
+std::size_t Client::pendingBytes(void) const {
+    return serverReplies.bytes() + _outBuffer.size();
+}
+
+// Only a DEFLATE stream goes through _outBuffer; plain output is written
+// from the queued chunks directly
+bool Client::compressesOutput(void) const {
+    return _deflate != NULL || _compressionPending;
+}
+
+void Client::touch(void) {
+    _lastActivity = time(NULL);
+    if (_hibernating) {
+        _hibernating = false;
+        --_hibernatingTotal;
+    }
+    if (_idleTail != this) {
+        unlinkIdle();
+        linkIdle();
+    }
+    return;
+}
+
+void Client::linkIdle(void) {
+    _idlePrev = _idleTail;
+    _idleNext = NULL;
+    if (_idleTail != NULL) {
+        _idleTail->_idleNext = this;
+    } else {
+        _idleHead = this;
+    }
+    _idleTail = this;
+}
+
+void Client::unlinkIdle(void) {
+    if (_idlePrev == NULL && _idleHead != this) {
+        return;
+    }
+    if (_idlePrev != NULL) {
+        _idlePrev->_idleNext = _idleNext;
+    } else {
+        _idleHead = _idleNext;
+    }
+    if (_idleNext != NULL) {
+        _idleNext->_idlePrev = _idlePrev;
+    } else {
+        _idleTail = _idlePrev;
+    }
+    _idlePrev = NULL;
+    _idleNext = NULL;
+}
+
+time_t Client::getLastActivity(void) const {
+    return _lastActivity;
+}
+
+long long Client::getConnectedAt(void) const {
+    return _identity->connectedAt;
+}
+
+void Client::addRegistration(int flags) {
+    _registration |= flags;
+    return;
+}
+
+int Client::getRegistration(void) const {
+    return _registration;
+}
+
+bool Client::isFullyRegistered(void) const {
+    return (_registration & REG_COMPLETE) == REG_COMPLETE;
 }
 
 bool Client::getIsCorrectPassword(void) const {
@@ -70,21 +266,333 @@ void Client::clearBuffer() {
     _messageBuffer.clear();
 }
 
+std::string& Client::getOutBuffer() {
+    return _outBuffer;
+}
+
+void Client::consumeOutput(std::size_t bytes) {
+    _outBuffer.erase(0, bytes);
+    _outBufferTotal -= bytes;
+}
+
+// With CAP compress the queue is drained into _outBuffer: what was queued
+// up to the CAP ACK raw, everything after it through the DEFLATE stream.
+void Client::flushReplies(int compressionLevel) {
+    std::string payload;
+    std::size_t before = _outBuffer.size();
+
+    if (!compressesOutput()) {
+        return;
+    }
+    if (_compressionPending) {
+        serverReplies.moveTo(_outBuffer, _compressionStart);
+        _compressionPending = false;
+        _deflate = new DeflateStream(compressionLevel);
+        if (!_deflate->isReady()) {
+            delete _deflate;
+            _deflate = NULL;
+        }
+    }
+
+    serverReplies.moveTo(payload, serverReplies.size());
+    if (!payload.empty()
+        && (_deflate == NULL || !_deflate->compress(payload, _outBuffer, compressionLevel))) {
+        _outBuffer += payload;
+    }
+    _outBufferTotal += _outBuffer.size() - before;
+}
+
+// Gives back capacity left over from a burst once the queues are empty.
+// clear() and erase() keep the allocation, so swap with an empty one.
+void Client::trimBuffers(void) {
+    if (_outBuffer.empty() && _outBuffer.capacity() > IDLE_BUFFER_CAPACITY) {
+        std::string().swap(_outBuffer);
+    }
+    if (_messageBuffer.empty() && _messageBuffer.capacity() > IDLE_BUFFER_CAPACITY) {
+        std::string().swap(_messageBuffer);
+    }
+    serverReplies.shrink();
+}
+
+// Everything an idle client's buffers and identity hold past their
+// contents is handed back; they grow again with the next line read or
+// reply queued. A partial line already read is kept, just shrunk to fit.
+// Returns the heap bytes released.
+std::size_t Client::hibernate(void) {
+    std::string *strings[] = { &_messageBuffer, &_outBuffer, &_identity->username,
+                               &_identity->hostname, &_identity->resumeToken };
+    std::size_t before = serverReplies.heapBytes();
+    std::size_t after;
+
+    for (std::size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); ++i) {
+        before += MemoryAccount::string(*strings[i]);
+    }
+    serverReplies.shrink();
+    after = serverReplies.heapBytes();
+    for (std::size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); ++i) {
+        if (strings[i]->empty()) {
+            std::string().swap(*strings[i]);
+        } else {
+            strings[i]->shrink_to_fit();
+        }
+        after += MemoryAccount::string(*strings[i]);
+    }
+    if (!_hibernating) {
+        _hibernating = true;
+        ++_hibernatingTotal;
+    }
+    // off the activity list until the next read puts it back
+    unlinkIdle();
+    return before - after;
+}
+
+bool Client::isHibernating(void) const {
+    return _hibernating;
+}
+
+void Client::startCompression(void) {
+    if (_deflate != NULL || _compressionPending) {
+        return;
+    }
+    _compressionPending = true;
+    _compressionStart = serverReplies.size();
+    // replies after the ACK must stay behind the ones before it
+    serverReplies.setReorder(false);
+}
+
+void Client::requestResume(void) {
+    _resumeRequested = true;
+}
+
+bool Client::wantsResume(void) const {
+    return _resumeRequested;
+}
+
+void Client::setResumeToken(const std::string &token) {
+    _identity->resumeToken = token;
+}
+
+const std::string &Client::getResumeToken(void) const {
+    return _identity->resumeToken;
+}
+
+void Client::setResumed(bool resumed) {
+    _resumed = resumed;
+}
+
+bool Client::isResumed(void) const {
+    return _resumed;
+}
+
+// a detached session has no socket to go idle on
+void Client::setDetached(bool detached) {
+    _detached = detached;
+    if (detached) {
+        unlinkIdle();
+    }
+}
+
+bool Client::isDetached(void) const {
+    return _detached;
+}
+
+bool Client::isReachable(void) const {
+    return _fd != -1 || _detached;
+}
+
+const DeflateStream *Client::getDeflateStream(void) const {
+    return _deflate;
+}
+
+bool Client::enableZeroCopy(void) {
+#ifdef IRC_ZEROCOPY
+    int opt = 1;
+    _zeroCopy = (setsockopt(_fd, SOL_SOCKET, SO_ZEROCOPY, &opt, sizeof(opt)) == 0);
+#endif
+    return _zeroCopy;
+}
+
+void Client::disableZeroCopy(void) {
+    _zeroCopy = false;
+}
+
+bool Client::isZeroCopyEnabled(void) const {
+    return _zeroCopy;
+}
+
+void Client::pinOutput(std::size_t bytesSent) {
+    std::string rest = _outBuffer.substr(bytesSent);
+
+    // swap() hands the heap block itself over, so the address the kernel
+    // is reading from stays valid until releasePinned() drops it
+    if (_zeroCopyPinned == NULL) {
+        _zeroCopyPinned = new std::deque<PinnedOutput>();
+    }
+    _zeroCopyPinned->push_back(PinnedOutput());
+    _zeroCopyPinned->back().seq = _zeroCopySeq++;
+    _zeroCopyPinned->back().bytes.swap(_outBuffer);
+    _outBuffer.swap(rest);
+    _outBufferTotal -= bytesSent;
+}
+
+// The chunks stay referenced, so neither the pool nor a later reply
+// reuses memory the kernel has yet to read
+void Client::pinQueued(std::size_t bytesSent) {
+    if (_zeroCopyPinned == NULL) {
+        _zeroCopyPinned = new std::deque<PinnedOutput>();
+    }
+    _zeroCopyPinned->push_back(PinnedOutput());
+    _zeroCopyPinned->back().seq = _zeroCopySeq++;
+    serverReplies.retainFront(bytesSent, _zeroCopyPinned->back().buffers);
+    serverReplies.consume(bytesSent);
+}
+
+std::size_t releasePinnedRange(std::deque<PinnedOutput> &pinned, unsigned int first, unsigned int last) {
+    std::size_t released = 0;
+    std::deque<PinnedOutput>::iterator it = pinned.begin();
+
+    while (it != pinned.end()) {
+        if (it->seq - first <= last - first) {
+            for (std::size_t i = 0; i < it->buffers.size(); ++i) {
+                it->buffers[i]->release();
+            }
+            it = pinned.erase(it);
+            ++released;
+        } else {
+            ++it;
+        }
+    }
+    return released;
+}
+
+std::size_t Client::releasePinned(unsigned int first, unsigned int last) {
+    if (_zeroCopyPinned == NULL) {
+        return 0;
+    }
+    std::size_t released = releasePinnedRange(*_zeroCopyPinned, first, last);
+
+    if (_zeroCopyPinned->empty()) {
+        delete _zeroCopyPinned;
+        _zeroCopyPinned = NULL;
+    }
+    return released;
+}
+
+std::size_t Client::getPinnedCount(void) const {
+    return _zeroCopyPinned == NULL ? 0 : _zeroCopyPinned->size();
+}
+
+std::deque<PinnedOutput> *Client::takePinned(void) {
+    std::deque<PinnedOutput> *pinned = _zeroCopyPinned;
+
+    _zeroCopyPinned = NULL;
+    return pinned;
+}
+
+void Client::measureMemory(MemoryUsage &usage, MemoryTag self) const {
+    std::size_t own = MemoryAccount::block(sizeof(Client)) + MemoryAccount::block(sizeof(ClientIdentity))
+                      + MemoryAccount::string(_identity->username)
+                      + MemoryAccount::string(_identity->hostname)
+                      + MemoryAccount::string(_identity->resumeToken);
+    std::size_t output = MemoryAccount::string(_outBuffer) + serverReplies.heapBytes();
+    std::set<std::string>::const_iterator it;
+
+    for (it = _identity->memberships.begin(); it != _identity->memberships.end(); ++it) {
+        own += MemoryAccount::treeNode(sizeof(std::string)) + MemoryAccount::string(*it);
+    }
+    for (it = _identity->invites.begin(); it != _identity->invites.end(); ++it) {
+        own += MemoryAccount::treeNode(sizeof(std::string)) + MemoryAccount::string(*it);
+    }
+    if (_zeroCopyPinned != NULL) {
+        output += MemoryAccount::block(sizeof(*_zeroCopyPinned));
+        for (std::size_t i = 0; i < _zeroCopyPinned->size(); ++i) {
+            const PinnedOutput &pinned = (*_zeroCopyPinned)[i];
+            output += sizeof(PinnedOutput) + MemoryAccount::string(pinned.bytes)
+                      + pinned.buffers.capacity() * sizeof(OutputBuffer *);
+        }
+    }
+    usage.charge(self, own);
+    usage.charge(self == MEM_HISTORY ? self : MEM_INPUT, MemoryAccount::string(_messageBuffer));
+    usage.charge(self == MEM_HISTORY ? self : MEM_OUTPUT, output);
+}
+
 int Client::getFd(void) const {
     return _fd;
 }
 
-bool Server::isUserInServer(std::string nickname) {
-    return std::find(_nicknames.begin(), _nicknames.end(), nickname) != _nicknames.end();
+ClientHandle Client::getHandle(void) const {
+    ClientHandle handle;
+
+    handle.fd = _fd;
+    handle.generation = _generation;
+    return handle;
+}
+
+void Client::addMembership(const std::string &channelName) {
+    _identity->memberships.insert(channelName);
 }
 
-Client* Server::getClient(std::string nickname) {
-    std::map<int, Client*>::iterator it;
-    for (it = _clients.begin(); it != _clients.end(); ++it) {
-        Client* client = it->second;
-        if (client->getNickname() == nickname) {
-            return client;
+void Client::removeMembership(const std::string &channelName) {
+    _identity->memberships.erase(channelName);
+}
+
+const std::set<std::string> &Client::getMemberships(void) const {
+    return _identity->memberships;
+}
+
+void Client::addInvite(const std::string &channelName) {
+    _identity->invites.insert(channelName);
+}
+
+void Client::removeInvite(const std::string &channelName) {
+    _identity->invites.erase(channelName);
+}
+
+const std::set<std::string> &Client::getInvites(void) const {
+    return _identity->invites;
+}
+
+void Server::hibernateIdleClients(long long now) {
+    if (now - _lastIdleSweep < IDLE_SWEEP_INTERVAL * 1000000LL) {
+        return;
+    }
+    _lastIdleSweep = now;
+
+    // Hibernating clients are off the activity list, so only the ones
+    // that went idle since the last sweep are visited, plus any still
+    // held back below
+    time_t idleSince = time(NULL) - IDLE_HIBERNATE_SECONDS;
+    Client *next;
+    for (Client *client = Client::leastRecentlyActive();
+         client != NULL && client->getLastActivity() <= idleSince; client = next) {
+        next = client->nextByActivity();
+        // anything still queued or buffered is left to finish first
+        if (client->hasPendingOutput() || client->isReady() || client->isSuspended()
+            || client->isClosing()) {
+            continue;
         }
+        ++_hibernations;
+        _reclaimedBytes += client->hibernate();
+    }
+    _reclaimedBytes += OutputBuffer::trimPool();
+}
+
+Client *Server::resolveClient(const ClientHandle &handle) {
+    Client *client = _clients.find(handle.fd);
+
+    if (client == NULL || client->getHandle().generation != handle.generation) {
+        return NULL;
     }
-    return NULL;
+    return client;
+}
+
+bool Server::isUserInServer(const std::string &nickname) const {
+    return getClient(nickname) != NULL;
+}
+
+// A detached session keeps its nick, and messages to it are replayed
+Client* Server::getClient(const std::string &nickname) const {
+    std::unordered_map<std::string, Client *>::const_iterator it = _nicknames.find(ChannelTable::fold(nickname));
+
+    return it == _nicknames.end() ? NULL : it->second;
 }
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include "../Includes/ClientTable.hpp"
+
+ClientTable::ClientTable(void) : _count(0) {
+    return;
+}
+
+void ClientTable::reserve(std::size_t fds) {
+    _slots.reserve(fds);
+}
+
+void ClientTable::grow(int fd) {
+    if (static_cast<std::size_t>(fd) >= _slots.size()) {
+        Slot empty = { NULL, FD_FREE };
+        _slots.resize(fd + 1, empty);
+    }
+}
+
+void ClientTable::insert(int fd, Client *client) {
+    grow(fd);
+    if (_slots[fd].kind != FD_CLIENT) {
+        ++_count;
+    }
+    _slots[fd].client = client;
+    _slots[fd].kind = FD_CLIENT;
+}
+
+void ClientTable::erase(int fd) {
+    if (fd < 0 || static_cast<std::size_t>(fd) >= _slots.size()) {
+        return;
+    }
+    if (_slots[fd].kind == FD_CLIENT) {
+        --_count;
+    }
+    _slots[fd].client = NULL;
+    _slots[fd].kind = FD_FREE;
+}
+
+void ClientTable::setKind(int fd, FdKind kind) {
+    if (fd < 0) {
+        return;
+    }
+    grow(fd);
+    if (_slots[fd].kind == FD_CLIENT) {
+        --_count;
+        _slots[fd].client = NULL;
+    }
+    _slots[fd].kind = kind;
+}
+
+FdKind ClientTable::kindOf(int fd) const {
+    if (fd < 0 || static_cast<std::size_t>(fd) >= _slots.size()) {
+        return FD_FREE;
+    }
+    return static_cast<FdKind>(_slots[fd].kind);
+}
+
+Client *ClientTable::find(int fd) const {
+    if (fd < 0 || static_cast<std::size_t>(fd) >= _slots.size()) {
+        return NULL;
+    }
+    return _slots[fd].client;
+}
+
+int ClientTable::next(int fd) const {
+    for (std::size_t i = fd + 1; i < _slots.size(); ++i) {
+        if (_slots[i].kind == FD_CLIENT) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
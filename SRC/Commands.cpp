@@ -1,9 +1,20 @@
 #include "../Includes/Channel.hpp"
 #include "../Includes/Server.hpp"
 
-void Server::addNewUser(Client* client, const ParseMessage &parsedMsg)
+// Each registration step names the steps it depends on and the handler
+// that runs it; the handler returns the REG_* flags it has completed.
+const Server::RegistrationStep Server::_registrationSteps[] = {
+    { "CAP",    0,                          &Server::handleCapCommand },
+    { "PASS",   REG_CAP_STARTED,            &Server::handlePassCommand },
+    { "NICK",   REG_CAP_STARTED | REG_PASS, &Server::registerNick },
+    { "USER",   REG_CAP_STARTED | REG_PASS, &Server::addNewUser },
+    { "RESUME", REG_CAP_STARTED | REG_PASS, &Server::resumeSession },
+    { NULL,     0,                          NULL }
+};
+
+int Server::addNewUser(Client* client, const ParseMessage &parsedMsg)
 {
-    std::vector<std::string> params = parsedMsg.getParams();
+    const ScratchVector<std::string> &params = parsedMsg.getParams();
     
     if (client->getUsername().empty() == true && !params.empty())
     {
@@ -11,67 +22,97 @@ void Server::addNewUser(Client* client, const ParseMessage &parsedMsg)
         std::cout << "User registered: " << client->getUsername() 
                   << " (Real name: " << client->getUsername() << ")" << std::endl;
     }
+    return client->getUsername().empty() ? 0 : REG_USER;
+}
+
+int Server::registerNick(Client *client, const ParseMessage &parsedMsg)
+{
+    nickCommand(client, parsedMsg.getParams());
+    return client->getNickname().empty() ? 0 : REG_NICK;
 }
 
 void Server::connectUser(Client *client, const ParseMessage &parsedMsg) 
 {
     const std::string &command = parsedMsg.getCmd();
-    const std::vector<std::string> &params = parsedMsg.getParams();
 
-    if (command == "CAP")
+    for (const RegistrationStep *step = _registrationSteps; step->command; ++step)
     {
-        handleCapCommand(client, params);
-    }
-    else if (client->conRegi[0] == true && command == "PASS") {
-        handlePassCommand(client, params);
-        if (client->getIsCorrectPassword() == true) {
-            client->conRegi[1] = true;
-        }
+        if (command != step->command)
+            continue;
+        if ((client->getRegistration() & step->needs) == step->needs)
+            client->addRegistration((this->*step->handler)(client, parsedMsg));
+        break;
     }
-    else if (client->conRegi[1] == true && (command == "USER" || command == "NICK"))
-    {
-        if (command == "USER") {
-            addNewUser(client, parsedMsg);
-        }
-        else if (command == "NICK") {
-            nickCommand(client, params);
-        }
+    if (client->getRegistration() == (REG_COMPLETE & ~REG_ADMITTED))
+        queueRegistration(client);
+    return ;
+}
 
-        if (client->getUsername() != "" && client->getNickname() != "") {
-            client->conRegi[2] = true;
-        }
-    }
-    if ( client->isRegistered == true && client->conRegi[2] == true )
-    {
+void Server::completeRegistration(Client *client)
+{
+    long long elapsed = ft_monotonicUsec() - client->getConnectedAt();
+
+    ++_welcomes;
+    _welcomeMicros += elapsed;
+    if (elapsed > _welcomeWorst)
+        _welcomeWorst = elapsed;
+    // a resumed session is already known to its client and channels
+    if (!client->isResumed())
         motdCommand(client);
-    }
-    return ;
+    if (client->wantsResume())
+        issueResumeToken(client);
 }
 
-void Server::handleCapCommand(Client *client, const std::vector<std::string> &params) 
+int Server::handleCapCommand(Client *client, const ParseMessage &parsedMsg) 
 {
+    const ScratchVector<std::string> &params = parsedMsg.getParams();
+    const std::string &trailing = parsedMsg.getTrailing();
+
     if (params.size() > 0 && params[0] == "LS") {
-        client->conRegi[0] = true;
-        client->serverReplies.push_back(":irssi CAP * LS :  \r\n");
-    } else if ( client->conRegi[0] == true ) {
-        if (params.size() == 1 && params[0] == "REQ") {
+        client->serverReplies.push_back(":irssi CAP * LS :compress resume\r\n");
+        return REG_CAP_STARTED;
+    } else if ( client->getRegistration() & REG_CAP_STARTED ) {
+        if (params.size() >= 1 && params[0] == "REQ" && (!trailing.empty() || params.size() == 2)) {
+            const std::string &requested = trailing.empty() ? params[1] : trailing;
+            std::istringstream iss(requested);
+            std::string capability;
+            bool known = true;
+
+            while (iss >> capability)
+                known = known && (capability == "compress" || capability == "resume");
+            if (!known) {
+                client->serverReplies.push_back(":irssi CAP * NAK :" + requested + "\r\n");
+                return 0;
+            }
+            if (requested.find("resume") != std::string::npos)
+                client->requestResume();
+            client->serverReplies.push_back(":irssi CAP * ACK :" + requested + "\r\n");
+            // CAP compress switches at a fixed point: the ACK is the last
+            // raw line, and every byte after it is one DEFLATE stream
+            if (requested.find("compress") != std::string::npos)
+                client->startCompression();
+        } else if (params.size() == 1 && params[0] == "REQ") {
             client->serverReplies.push_back(":irssi CAP * REQ:  \r\n");
         } else if (params.size() == 1 && params[0] == "NAK" ) {
             client->serverReplies.push_back(":irssi CAP * NAK:  \r\n");
         } else if (params.size() == 1 && params[0] == "ACK" ) {
             client->serverReplies.push_back(":irssi CAP * ACK:  \r\n");
         } else if (params.size() == 1 && params[0] == "END") {
-            client->isRegistered = true;
+            return REG_CAP_ENDED;
         }
     }
+    return 0;
 }
 
-bool Server::handlePassCommand(Client *client, const std::vector<std::string> &params) {
+int Server::handlePassCommand(Client *client, const ParseMessage &parsedMsg) {
+    const ScratchVector<std::string> &params = parsedMsg.getParams();
+
     if (client->getIsCorrectPassword() == false) 
     {
         if (!params.empty() && params[0] == getServerPassword())
         {
             client->setIsCorrectPassword(true);
+            return REG_PASS;
         } else 
         {
             client->serverReplies.push_back(ERR_PASSWDMISMATCH(std::string("ircserver")));
@@ -79,14 +120,14 @@ bool Server::handlePassCommand(Client *client, const std::vector<std::string> &p
     } else {
         client->serverReplies.push_back(ERR_ALREADYREGISTERED(std::string("ircserver")));
     }
-    return true;
+    return 0;
 }
 
 bool Server::isValidIRCCommand(const std::string& command) 
 {
     static const char* validCommands[] = {
         "JOIN", "MODE", "TOPIC", "NICK", "QUIT", "PRIVMSG", "KICK",
-        "INVITE", "PING", "motd", "CAP", "PASS", "USER", "PART", "WHO", "NOTICE", "WHOIS", 0
+        "INVITE", "PING", "motd", "CAP", "PASS", "USER", "PART", "WHO", "NOTICE", "WHOIS", "RESUME", 0
     };
 
     for (const char** cmd = validCommands; *cmd; ++cmd) {
@@ -108,36 +149,34 @@ void    Server::displayCommand(  const ParseMessage &parsedMessage ) const {
     return;
 }
 
-void Server::processCommand(Client *client, const ParseMessage &parsedMsg)
+CommandResult Server::processCommand(Client *client, const ParseMessage &parsedMsg)
 {
-    std::string command;
-    std::vector<std::string> params;
-    if(parsedMsg.getCmd().empty() == true) 
+    const std::string &command = parsedMsg.getCmd();
+    const ScratchVector<std::string> &params = parsedMsg.getParams();
+    if(command.empty() == true) 
     {
-        return;
+        return COMMAND_DONE;
     }
     displayCommand(parsedMsg);
-    command = parsedMsg.getCmd();
-    params = parsedMsg.getParams();
     if(params.size() < 1 && parsedMsg.getTrailing().empty() == true && command != "QUIT" && command != "motd")
     {
         client->serverReplies.push_back(ERR_NEEDMOREPARAMS(std::string("ircserver") ,command));
-        return;
+        return COMMAND_DONE;
     }
     if(isValidIRCCommand(parsedMsg.getCmd()) == false)
     {
         client->serverReplies.push_back(ERR_UNKNOWNCOMMAND(std::string("ircserver"), parsedMsg.getCmd()));
-        return;
+        return COMMAND_DONE;
     }
     if (command == "QUIT")
-        quitCommand(parsedMsg.getTrailing(), client);
-    if( client->isRegistered == false || client->conRegi[2] == false )
+        return quitCommand(parsedMsg.getTrailing(), client);
+    if( client->isFullyRegistered() == false )
     {
         connectUser(client, parsedMsg);    
     }
-    else if ( client->isRegistered == true && client->conRegi[2] == true )
+    else
     {
-        if (command == "USER" || command == "PASS")
+        if (command == "USER" || command == "PASS" || command == "RESUME")
         {
             client->serverReplies.push_back(ERR_ALREADYREGISTERED(std::string("ircserver")));
         }
@@ -186,5 +225,5 @@ void Server::processCommand(Client *client, const ParseMessage &parsedMsg)
             noticeCommand(client, parsedMsg);
         }
     }
-    return;
+    return COMMAND_DONE;
 }
\ No newline at end of file
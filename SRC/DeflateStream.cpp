@@ -0,0 +1,116 @@
+#include "../Includes/DeflateStream.hpp"
+#include "../Includes/MemoryStats.hpp"
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+
+unsigned long long DeflateStream::_totalRawBytes = 0;
+unsigned long long DeflateStream::_totalCompressedBytes = 0;
+long long DeflateStream::_totalCpuMicros = 0;
+std::size_t DeflateStream::_openStreams = 0;
+
+static long long threadCpuMicros(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<long long>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// zlib's window and hash tables, about 256 KiB a stream at the default
+// settings, are charged to MEM_COMPRESSION. Each block carries its size
+// so the free can be charged back.
+static voidpf countedAlloc(voidpf, uInt items, uInt size)
+{
+    std::size_t bytes = static_cast<std::size_t>(items) * size;
+    std::size_t *block = static_cast<std::size_t *>(malloc(bytes + sizeof(std::max_align_t)));
+
+    if (block == NULL) {
+        return Z_NULL;
+    }
+    *block = bytes;
+    MemoryAccount::allocate(MEM_COMPRESSION, MemoryAccount::block(bytes + sizeof(std::max_align_t)));
+    return reinterpret_cast<char *>(block) + sizeof(std::max_align_t);
+}
+
+static void countedFree(voidpf, voidpf address)
+{
+    std::size_t *block = reinterpret_cast<std::size_t *>(static_cast<char *>(address) - sizeof(std::max_align_t));
+
+    MemoryAccount::release(MEM_COMPRESSION, MemoryAccount::block(*block + sizeof(std::max_align_t)));
+    free(block);
+}
+
+DeflateStream::DeflateStream(int level) : _level(level),
+                                          _ready(false),
+                                          _rawBytes(0),
+                                          _compressedBytes(0),
+                                          _cpuMicros(0) {
+    memset(&_stream, 0, sizeof(_stream));
+    _stream.zalloc = countedAlloc;
+    _stream.zfree = countedFree;
+    _ready = (deflateInit(&_stream, level) == Z_OK);
+    MemoryAccount::allocate(MEM_COMPRESSION, MemoryAccount::block(sizeof(DeflateStream)));
+    ++_openStreams;
+    return;
+}
+
+DeflateStream::~DeflateStream(void) {
+    if (_ready) {
+        deflateEnd(&_stream);
+    }
+    MemoryAccount::release(MEM_COMPRESSION, MemoryAccount::block(sizeof(DeflateStream)));
+    --_openStreams;
+    return;
+}
+
+bool DeflateStream::compress(const std::string &input, std::string &output, int level) {
+    unsigned char chunk[16384];
+    long long start = threadCpuMicros();
+    int status;
+
+    if (!_ready) {
+        return false;
+    }
+
+    // Retune to the current CPU headroom; anything already buffered in
+    // the stream is flushed into output first.
+    if (level != _level) {
+        _stream.next_in = NULL;
+        _stream.avail_in = 0;
+        do {
+            _stream.next_out = chunk;
+            _stream.avail_out = sizeof(chunk);
+            status = deflateParams(&_stream, level, Z_DEFAULT_STRATEGY);
+            output.append(reinterpret_cast<char *>(chunk), sizeof(chunk) - _stream.avail_out);
+            _compressedBytes += sizeof(chunk) - _stream.avail_out;
+            _totalCompressedBytes += sizeof(chunk) - _stream.avail_out;
+        } while (status == Z_BUF_ERROR && _stream.avail_out == 0);
+        // a failed retune keeps the old level and is tried again next flush
+        if (status == Z_OK) {
+            _level = level;
+        }
+    }
+
+    _stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+    _stream.avail_in = static_cast<uInt>(input.size());
+    do {
+        _stream.next_out = chunk;
+        _stream.avail_out = sizeof(chunk);
+        status = deflate(&_stream, Z_SYNC_FLUSH);
+        if (status == Z_STREAM_ERROR) {
+            _ready = false;
+            return false;
+        }
+        output.append(reinterpret_cast<char *>(chunk), sizeof(chunk) - _stream.avail_out);
+        _compressedBytes += sizeof(chunk) - _stream.avail_out;
+        _totalCompressedBytes += sizeof(chunk) - _stream.avail_out;
+    } while (_stream.avail_out == 0);
+
+    long long micros = threadCpuMicros() - start;
+    _rawBytes += input.size();
+    _cpuMicros += micros;
+    _totalRawBytes += input.size();
+    _totalCpuMicros += micros;
+    return true;
+}
@@ -0,0 +1,80 @@
+#include "../Includes/MemoryStats.hpp"
+#include <fstream>
+#include <unistd.h>
+
+std::size_t MemoryAccount::_live[MEM_TAGS];
+std::size_t MemoryAccount::_peak[MEM_TAGS];
+
+MemoryUsage::MemoryUsage(void) {
+    for (int tag = 0; tag < MEM_TAGS; ++tag) {
+        bytes[tag] = 0;
+    }
+}
+
+std::size_t MemoryUsage::total(void) const {
+    std::size_t sum = 0;
+
+    for (int tag = 0; tag < MEM_TAGS; ++tag) {
+        sum += bytes[tag];
+    }
+    return sum;
+}
+
+void MemoryAccount::allocate(MemoryTag tag, std::size_t bytes) {
+    _live[tag] += bytes;
+    if (_live[tag] > _peak[tag]) {
+        _peak[tag] = _live[tag];
+    }
+}
+
+void MemoryAccount::observe(MemoryTag tag, std::size_t bytes) {
+    if (bytes > _peak[tag]) {
+        _peak[tag] = bytes;
+    }
+}
+
+void MemoryAccount::record(const MemoryUsage &usage) {
+    for (int tag = 0; tag < MEM_TAGS; ++tag) {
+        observe(static_cast<MemoryTag>(tag), usage.bytes[tag]);
+    }
+}
+
+const char *MemoryAccount::tagName(int tag) {
+    static const char *names[MEM_TAGS] = {
+        "clients", "channels", "input", "output", "history", "indexes", "parser", "compression"
+    };
+
+    return names[tag];
+}
+
+long MemoryAccount::residentBytes(void) {
+    std::ifstream statm("/proc/self/statm");
+    long pages = 0;
+    long resident = 0;
+
+    if (statm >> pages >> resident) {
+        return resident * sysconf(_SC_PAGESIZE);
+    }
+    return -1;
+}
+
+// glibc: an 8-byte header, 16-byte granularity, 32 bytes at least
+std::size_t MemoryAccount::block(std::size_t bytes) {
+    std::size_t size = (bytes + 8 + 15) & ~static_cast<std::size_t>(15);
+
+    return size < 32 ? 32 : size;
+}
+
+std::size_t MemoryAccount::string(const std::string &text) {
+    const char *begin = reinterpret_cast<const char *>(&text);
+
+    if (text.data() >= begin && text.data() < begin + sizeof(text)) {
+        return 0;
+    }
+    return block(text.capacity() + 1);
+}
+
+// colour, parent and two children ahead of the entry
+std::size_t MemoryAccount::treeNode(std::size_t value) {
+    return block(32 + value);
+}
@@ -0,0 +1,156 @@
+#include "../Includes/Server.hpp"
+
+long long ft_monotonicUsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<long long>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void Server::adjustCompressionLevel(long long elapsed) {
+    // Fraction of wall time the loop spent working rather than in poll()
+    long long busyPercent = elapsed > 0 ? (_busyMicros * 100) / elapsed : 0;
+
+    if (busyPercent >= 75) {
+        _compressionLevel = COMPRESSION_MIN_LEVEL;
+    } else if (busyPercent >= 50) {
+        _compressionLevel = (COMPRESSION_MIN_LEVEL + COMPRESSION_MAX_LEVEL) / 2;
+    } else {
+        _compressionLevel = COMPRESSION_MAX_LEVEL;
+    }
+}
+
+static std::size_t vectorBytes(std::size_t capacity, std::size_t element)
+{
+    return capacity > 0 ? MemoryAccount::block(capacity * element) : 0;
+}
+
+// libstdc++ keeps a deque in 512-byte blocks
+static std::size_t dequeBytes(std::size_t size, std::size_t element)
+{
+    return MemoryAccount::block((size * element / 512 + 1) * 512);
+}
+
+// One walk over every subsystem, O(clients + channels); made for the
+// periodic snapshot and on request, never on the per-message path
+void Server::measureMemory(MemoryUsage &usage) const {
+    for (int fd = _clients.next(-1); fd != -1; fd = _clients.next(fd)) {
+        _clients.find(fd)->measureMemory(usage, MEM_CLIENTS);
+    }
+    for (std::map<std::string, DetachedSession>::const_iterator it = _detachedSessions.begin(); it != _detachedSessions.end(); ++it) {
+        it->second.client->measureMemory(usage, MEM_HISTORY);
+        usage.charge(MEM_HISTORY, MemoryAccount::treeNode(sizeof(*it)) + MemoryAccount::string(it->first));
+    }
+    usage.charge(MEM_CHANNELS, _channels.heapBytes());
+    for (int id = _channels.next(-1); id != -1; id = _channels.next(id)) {
+        usage.charge(MEM_CHANNELS, _channels.at(id).heapBytes());
+    }
+    for (std::map<int, AdminSession>::const_iterator it = _adminSessions.begin(); it != _adminSessions.end(); ++it) {
+        usage.charge(MEM_INDEXES, MemoryAccount::treeNode(sizeof(*it)));
+        usage.charge(MEM_INPUT, MemoryAccount::string(it->second.input));
+        usage.charge(MEM_OUTPUT, MemoryAccount::string(it->second.output));
+    }
+    // closed sockets still waiting on zero-copy completions; their chunks
+    // are counted with the rest just below
+    for (std::map<int, ZeroCopyDrain>::const_iterator it = _zeroCopyDrains.begin(); it != _zeroCopyDrains.end(); ++it) {
+        usage.charge(MEM_INDEXES, MemoryAccount::treeNode(sizeof(*it)));
+        usage.charge(MEM_OUTPUT, MemoryAccount::block(sizeof(*it->second.pinned)));
+        for (std::size_t i = 0; i < it->second.pinned->size(); ++i) {
+            usage.charge(MEM_OUTPUT, MemoryAccount::string((*it->second.pinned)[i].bytes));
+        }
+    }
+    // chunks and shared broadcast lines, including those queued for
+    // detached sessions
+    usage.charge(MEM_OUTPUT, MemoryAccount::live(MEM_OUTPUT));
+    usage.charge(MEM_COMPRESSION, MemoryAccount::live(MEM_COMPRESSION));
+    // the scratch arena's blocks
+    usage.charge(MEM_PARSER, MemoryAccount::live(MEM_PARSER));
+
+    std::size_t indexes = _clients.heapBytes()
+                          + vectorBytes(_fds.capacity(), sizeof(pollfd))
+                          + vectorBytes(_deferredFds.capacity(), sizeof(pollfd))
+                          + vectorBytes(_pollSlots.capacity(), sizeof(int))
+                          + vectorBytes(_releasedSlots.capacity(), sizeof(int))
+                          + _nicknames.bucket_count() * sizeof(void *)
+                          + vectorBytes(ReplyQueue::pending.capacity(), sizeof(ClientHandle))
+                          + dequeBytes(_readyClients.size(), sizeof(ClientHandle))
+                          + dequeBytes(_admissionQueue.size(), sizeof(ClientHandle))
+                          + dequeBytes(_priorityAdmissions.size(), sizeof(ClientHandle))
+                          + _knownAddresses.size() * MemoryAccount::treeNode(sizeof(in_addr_t))
+                          + _deferredRegistrations.size() * MemoryAccount::treeNode(sizeof(int));
+    for (std::unordered_map<std::string, Client *>::const_iterator it = _nicknames.begin(); it != _nicknames.end(); ++it) {
+        indexes += MemoryAccount::block(sizeof(void *) + sizeof(*it) + sizeof(std::size_t))
+                   + MemoryAccount::string(it->first);
+    }
+    indexes += _priorityAddresses.size() * MemoryAccount::treeNode(sizeof(in_addr_t));
+    usage.charge(MEM_INDEXES, indexes);
+}
+
+void Server::reportMetrics(long long now) {
+    long long elapsed = now - _lastMetrics;
+    // since startup, so closed connections still count
+    unsigned long long rawBytes = DeflateStream::totalRawBytes();
+    unsigned long long compressedBytes = DeflateStream::totalCompressedBytes();
+
+    adjustCompressionLevel(elapsed);
+
+    std::cout << "[metrics] clients=" << _clients.size()
+              << " fd_limit=" << _descriptorLimit
+              << " rejected_connections=" << _rejectedConnections
+              << " ready_clients=" << _readyClients.size()
+              << " budget_deferrals=" << _budgetDeferrals
+              << " hibernating_clients=" << Client::hibernatingTotal()
+              << " hibernations=" << _hibernations
+              << " reclaimed_bytes=" << _reclaimedBytes
+              << " channels=" << _channels.size()
+              << " loop_busy_pct=" << (elapsed > 0 ? (_busyMicros * 100) / elapsed : 0)
+              << " overload_level=" << _overloadLevel
+              << " overload_transitions=" << _overloadTransitions
+              << " queued_bytes=" << _queuedBytes
+              << " deferred_registrations=" << _deferredRegistrations.size()
+              << " shed_messages=" << _shedMessages
+              << " welcomes=" << _welcomes
+              << " welcome_avg_us=" << (_welcomes > 0 ? _welcomeMicros / static_cast<long long>(_welcomes) : 0)
+              << " welcome_max_us=" << _welcomeWorst
+              << " detached_sessions=" << _detachedSessions.size()
+              << " resumes=" << _resumes
+              << " resumes_expired=" << _resumesExpired
+              << " admission_queue=" << _admissionQueue.size()
+              << " admission_priority=" << _priorityAdmissions.size()
+              << " admitted=" << _admitted
+              << " admitted_priority=" << _admittedPriority
+              << " compress_clients=" << DeflateStream::openStreams()
+              << " compress_raw=" << rawBytes
+              << " compress_out=" << compressedBytes
+              << " compress_ratio=" << (compressedBytes > 0 ? static_cast<double>(rawBytes) / compressedBytes : 0.0)
+              << " compress_cpu_us=" << DeflateStream::totalCpuMicros()
+              << " compress_level=" << _compressionLevel << std::endl;
+    std::cout << "[metrics] copy_sends=" << _copySends
+              << " copy_bytes=" << _copyBytes
+              << " zerocopy_sends=" << _zeroCopySends
+              << " zerocopy_bytes=" << _zeroCopyBytes
+              << " zerocopy_copied=" << _zeroCopyCopied
+              << " zerocopy_threshold=" << ZEROCOPY_THRESHOLD
+              << " zerocopy_draining=" << _zeroCopyDrains.size()
+              << " output_chunks_pooled=" << OutputBuffer::pooled() << std::endl;
+
+    std::cout << "[metrics] fanout_broadcasts=" << Channel::fanout.broadcasts
+              << " fanout_recipients=" << Channel::fanout.recipients
+              << " fanout_bytes=" << Channel::fanout.bytes
+              << " output_buffers_created=" << OutputBuffer::created() << std::endl;
+
+    MemoryUsage usage;
+    measureMemory(usage);
+    MemoryAccount::record(usage);
+    std::cout << "[metrics] memory";
+    for (int tag = 0; tag < MEM_TAGS; ++tag) {
+        std::cout << " " << MemoryAccount::tagName(tag) << "=" << usage.bytes[tag];
+    }
+    std::cout << " parser_peak=" << MemoryAccount::peak(MEM_PARSER)
+              << " total=" << usage.total()
+              << " rss=" << MemoryAccount::residentBytes() << std::endl;
+
+    _busyMicros = 0;
+    _lastMetrics = now;
+}
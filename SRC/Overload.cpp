@@ -0,0 +1,76 @@
+#include "../Includes/Server.hpp"
+
+static const char *overloadLevelName(OverloadLevel level)
+{
+    static const char *names[] = {
+        "normal", "pause-accept", "defer-registration", "reduce-reads", "shed-traffic"
+    };
+    return names[level];
+}
+
+void Server::updateOverload(long long now, long long iterationMicros) {
+    if (iterationMicros > _worstIteration) {
+        _worstIteration = iterationMicros;
+    }
+    if (now - _overloadWindowStart < OVERLOAD_WINDOW_MS * 1000LL) {
+        return;
+    }
+
+    // detached sessions are left out: their queues wait for a resume
+    _queuedBytes = ReplyQueue::totalBytes() + Client::outBufferTotal();
+
+    bool overloaded = _worstIteration > OVERLOAD_ITERATION_US || _queuedBytes > OVERLOAD_QUEUE_BYTES;
+    bool relaxed = _worstIteration < OVERLOAD_ITERATION_US / 2 && _queuedBytes < OVERLOAD_QUEUE_BYTES / 2;
+
+    if (overloaded && _overloadLevel < LOAD_SHED_TRAFFIC) {
+        setOverloadLevel(static_cast<OverloadLevel>(_overloadLevel + 1));
+    } else if (relaxed && _overloadLevel > LOAD_NORMAL) {
+        setOverloadLevel(static_cast<OverloadLevel>(_overloadLevel - 1));
+    }
+
+    _worstIteration = 0;
+    _overloadWindowStart = now;
+}
+
+void Server::setOverloadLevel(OverloadLevel level) {
+    std::cout << "Overload level " << overloadLevelName(_overloadLevel) << " -> " << overloadLevelName(level)
+              << " (worst iteration " << _worstIteration << "us, queued " << _queuedBytes << " bytes)" << std::endl;
+    _overloadLevel = level;
+    ++_overloadTransitions;
+    if (_overloadLevel < LOAD_DEFER_REGISTRATION) {
+        resumeDeferredRegistrations();
+    }
+}
+
+bool Server::deferRegistration(Client *client) {
+    if (_overloadLevel < LOAD_DEFER_REGISTRATION || client->isFullyRegistered()) {
+        return false;
+    }
+    _deferredRegistrations.insert(client->getFd());
+    return true;
+}
+
+void Server::resumeDeferredRegistrations(void) {
+    std::set<int> deferred;
+
+    deferred.swap(_deferredRegistrations);
+    for (std::set<int>::iterator it = deferred.begin(); it != deferred.end(); ++it) {
+        Client *client = _clients.find(*it);
+        if (client == NULL) {
+            continue;
+        }
+        processBufferedLines(client);
+    }
+}
+
+int Server::readBudget(void) const {
+    return (_overloadLevel >= LOAD_REDUCE_READS) ? OVERLOAD_READ_SIZE : BUFFER_SIZE;
+}
+
+bool Server::shouldShed(const Channel &channel) {
+    if (_overloadLevel < LOAD_SHED_TRAFFIC || channel.getUsers().size() < OVERLOAD_LARGE_CHANNEL) {
+        return false;
+    }
+    ++_shedMessages;
+    return true;
+}
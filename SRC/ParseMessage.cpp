@@ -11,29 +11,19 @@ std::string ParseMessage::ft_trim(const std::string &str) const {
     return str.substr(start, end - start + 1);
 }
 
-std::vector<std::string> ft_split(std::string str, char delimiter)
+ScratchVector<std::string> ft_split(const std::string &str, char delimiter)
 {
-    std::vector<std::string> result;
-    std::string word;
-    
-    for (std::size_t i = 0; i < str.length(); ++i)
-    {
-        if(str[i] != delimiter)
-        {
-            word += str[i];
-        }
-        else
-        {
-            if(!word.empty())
-            {
-                result.push_back(word);
-                word.clear();
-            }
-        }
-    }
-    if(!word.empty())
+    ScratchVector<std::string> result;
+    std::size_t start = 0;
+
+    while (start < str.length())
     {
-        result.push_back(word);
+        std::size_t end = str.find(delimiter, start);
+        if (end == std::string::npos)
+            end = str.length();
+        if (end > start)
+            result.push_back(str.substr(start, end - start));
+        start = end + 1;
     }
     return result;
 }
@@ -65,13 +55,26 @@ std::vector<std::string> remove_spaces(std::string &str)
     return result;
 }
 
-ParseMessage::ParseMessage(const std::string& message)
+// Finds the next whitespace-delimited token at or after pos: it starts at
+// start and pos is left just past it
+static bool nextToken(const std::string &text, std::size_t &pos, std::size_t &start)
+{
+    while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos])))
+        ++pos;
+    if (pos == text.size())
+        return false;
+    start = pos;
+    while (pos < text.size() && !std::isspace(static_cast<unsigned char>(text[pos])))
+        ++pos;
+    return true;
+}
+
+ParseMessage::ParseMessage(std::string message)
 {
     if (message.empty()) {
         return;
     }
 
-    _msg = message;
     _msgLen = static_cast<int>(message.length());
     _cmd = "";
     _params.clear();
@@ -79,8 +82,8 @@ ParseMessage::ParseMessage(const std::string& message)
     _notValidParam = false;
     _errorMsg = "";
     std::string trimmedMsg = ft_trim(message);
-    std::string token;
-    std::istringstream iss(trimmedMsg);
+    std::size_t pos = 0;
+    std::size_t start;
     bool tagFlag = false;
     bool tagCmd = true;
 
@@ -88,11 +91,13 @@ ParseMessage::ParseMessage(const std::string& message)
         tagFlag = true;
     }
     
-    while (iss >> token) {
+    // Tokens are sliced out of trimmedMsg in place; only the fields kept
+    // on the ParseMessage are copied
+    while (nextToken(trimmedMsg, pos, start)) {
         if (tagFlag) {
-            if (token[0] == ':')
+            if (trimmedMsg[start] == ':')
             {
-                _cmd = token.substr(1);
+                _cmd = trimmedMsg.substr(start + 1, pos - start - 1);
                 tagFlag = false;
                 tagCmd = false;
                 continue;
@@ -103,32 +108,44 @@ ParseMessage::ParseMessage(const std::string& message)
         
         if (tagCmd) {
             
-            _cmd = token;
+            _cmd = trimmedMsg.substr(start, pos - start);
             tagCmd = false;
             continue;
         }
 
-        if (token[0] == ':') {
+        if (trimmedMsg[start] == ':') {
             
-            _trailing = ft_trim(message.substr(message.find(token) + 1)); 
+            _trailing = ft_trim(trimmedMsg.substr(start + 1));
             break;
         } else {
     
-            if (isValid(token)) {
-                
-                _params.push_back(token);
-            } else {
+            _params.push_back(trimmedMsg.substr(start, pos - start));
+            if (!isValid(_params.back())) {
                 
                 _notValidParam = true;
-                _errorMsg = "Invalid character in parameter: " + token;
+                _errorMsg = "Invalid character in parameter: " + _params.back();
+                _params.pop_back();
                 break;
             }   
         }
     }
 
+    _msg = std::move(message);
+    MemoryAccount::observe(MEM_PARSER, footprint());
     return;
 }
 
+std::size_t ParseMessage::footprint(void) const {
+    std::size_t bytes = MemoryAccount::string(_msg) + MemoryAccount::string(_cmd)
+                        + MemoryAccount::string(_trailing) + MemoryAccount::string(_errorMsg);
+
+    bytes += _params.capacity() * sizeof(std::string);
+    for (std::size_t i = 0; i < _params.size(); ++i) {
+        bytes += MemoryAccount::string(_params[i]);
+    }
+    return bytes;
+}
+
 bool ParseMessage::isValid(const std::string &param) const {
     std::string invalidChars = "\n\r\t:";
     std::size_t valid = param.find_first_of(invalidChars); 
@@ -0,0 +1,39 @@
+#include "../Includes/Server.hpp"
+
+void Server::loadPriorityAddresses(void) {
+    std::ifstream infile(PRIORITY_FILE, std::ios::in);
+    std::set<in_addr_t> addresses;
+    std::string line;
+
+    if (!infile.is_open()) {
+        std::cout << "Priority classes: " << PRIORITY_FILE << " not found, keeping "
+                  << _priorityAddresses.size() << " addresses" << std::endl;
+        return;
+    }
+    while (std::getline(infile, line)) {
+        std::string::size_type end = line.find_last_not_of(" \t\r");
+        if (line.empty() || line[0] == '#' || end == std::string::npos) {
+            continue;
+        }
+        in_addr address;
+        if (inet_pton(AF_INET, line.substr(0, end + 1).c_str(), &address) != 1) {
+            std::cerr << "Priority classes: skipping " << line.substr(0, end + 1)
+                      << ", not an IPv4 address" << std::endl;
+            continue;
+        }
+        addresses.insert(address.s_addr);
+    }
+    _priorityAddresses.swap(addresses);
+    std::cout << "Priority classes loaded: " << _priorityAddresses.size() << " addresses" << std::endl;
+
+    // Reclassify everyone already connected against the new list
+    for (int fd = _clients.next(-1); fd != -1; fd = _clients.next(fd)) {
+        applyPriority(_clients.find(fd));
+    }
+}
+
+// By source address only: a nickname or anything else the client sends
+// could be claimed by anyone
+void Server::applyPriority(Client *client) {
+    client->setPriority(_priorityAddresses.count(client->getAddress().sin_addr.s_addr) ? PRIORITY_HIGH : PRIORITY_NORMAL);
+}
@@ -0,0 +1,339 @@
+#include "../Includes/Server.hpp"
+
+std::vector<OutputBuffer *> OutputBuffer::_pool;
+std::size_t OutputBuffer::_poolLow = 0;
+unsigned long OutputBuffer::_created = 0;
+std::vector<ClientHandle> ReplyQueue::pending;
+std::vector<ClientHandle> ReplyQueue::overflowed;
+std::size_t ReplyQueue::_totalBytes = 0;
+
+OutputBuffer::OutputBuffer(std::size_t capacity) : _data(new char[capacity]),
+                                                  _size(0),
+                                                  _capacity(capacity),
+                                                  _refs(1) {
+    MemoryAccount::allocate(MEM_OUTPUT, MemoryAccount::block(sizeof(OutputBuffer)) + MemoryAccount::block(capacity));
+    return;
+}
+
+OutputBuffer::~OutputBuffer(void) {
+    MemoryAccount::release(MEM_OUTPUT, MemoryAccount::block(sizeof(OutputBuffer)) + MemoryAccount::block(_capacity));
+    delete[] _data;
+    return;
+}
+
+OutputBuffer *OutputBuffer::chunk(void) {
+    if (_pool.empty()) {
+        return new OutputBuffer(CHUNK_SIZE);
+    }
+    OutputBuffer *buffer = _pool.back();
+    _pool.pop_back();
+    _poolLow = std::min(_poolLow, _pool.size());
+    buffer->_refs = 1;
+    return buffer;
+}
+
+void OutputBuffer::releasePool(void) {
+    for (std::size_t i = 0; i < _pool.size(); ++i) {
+        delete _pool[i];
+    }
+    _pool.clear();
+    _poolLow = 0;
+}
+
+// The chunks at the bottom of the pool are the ones reuse never reached
+std::size_t OutputBuffer::trimPool(void) {
+    std::size_t unused = _poolLow;
+
+    for (std::size_t i = 0; i < unused; ++i) {
+        delete _pool[i];
+    }
+    _pool.erase(_pool.begin(), _pool.begin() + unused);
+    _poolLow = _pool.size();
+    return unused * (MemoryAccount::block(sizeof(OutputBuffer)) + MemoryAccount::block(CHUNK_SIZE));
+}
+
+OutputBuffer *OutputBuffer::create(const std::string &bytes) {
+    OutputBuffer *buffer = new OutputBuffer(bytes.size());
+
+    ++_created;
+    buffer->append(bytes.data(), bytes.size());
+    return buffer;
+}
+
+void OutputBuffer::release(void) {
+    if (--_refs != 0) {
+        return;
+    }
+    if (_capacity == CHUNK_SIZE && _pool.size() < POOL_MAX) {
+        _size = 0;
+        _pool.push_back(this);
+        return;
+    }
+    delete this;
+}
+
+void OutputBuffer::append(const char *bytes, std::size_t length) {
+    memcpy(_data + _size, bytes, length);
+    _size += length;
+}
+
+// PONG, ERROR and error numerics are never held up behind bulk output
+static bool isControlReply(const std::string &reply) {
+    std::size_t start = 0;
+
+    if (!reply.empty() && reply[0] == ':') {
+        start = reply.find(' ');
+        if (start == std::string::npos) {
+            return false;
+        }
+        ++start;
+    }
+    std::string command = reply.substr(start, reply.find(' ', start) - start);
+    if (command.size() == 3 && (command[0] == '4' || command[0] == '5')) {
+        return true;
+    }
+    return command == "PONG" || command == "ERROR";
+}
+
+ReplyQueue::ReplyQueue(void) : _head(0),
+                              _bytes(0),
+                              _front(0),
+                              _started(false),
+                              _reorder(true),
+                              _replayLimit(0),
+                              _tail(NULL),
+                              _owner(NULL) {
+    return;
+}
+
+ReplyQueue::~ReplyQueue(void) {
+    clear();
+    return;
+}
+
+void ReplyQueue::setOwner(Client *owner) {
+    _owner = owner;
+}
+
+void ReplyQueue::setReorder(bool reorder) {
+    _reorder = reorder;
+}
+
+void ReplyQueue::detach(std::size_t replayLines) {
+    if (_replayLimit == 0) {
+        _totalBytes -= _bytes;
+    }
+    _replayLimit = replayLines;
+    if (size() > _replayLimit) {
+        dropFront(size() - _replayLimit);
+    }
+}
+
+void ReplyQueue::addBytes(std::size_t bytes) {
+    _bytes += bytes;
+    if (_replayLimit == 0) {
+        _totalBytes += bytes;
+    }
+}
+
+void ReplyQueue::removeBytes(std::size_t bytes) {
+    _bytes -= bytes;
+    if (_replayLimit == 0) {
+        _totalBytes -= bytes;
+    }
+}
+
+void ReplyQueue::notify(void) {
+    if (empty() && _owner != NULL && _owner->getFd() != -1) {
+        pending.push_back(_owner->getHandle());
+    }
+}
+
+// Reported once, on the push that crosses the limit; a detached session
+// keeps its own replay limit instead
+void ReplyQueue::checkLimit(std::size_t added) {
+    if (_bytes > SENDQ_MAX && _bytes - added <= SENDQ_MAX && _owner != NULL && _owner->getFd() != -1) {
+        overflowed.push_back(_owner->getHandle());
+    }
+}
+
+void ReplyQueue::insert(const OutputSegment &segment, bool control) {
+    addBytes(segment.length);
+    checkLimit(segment.length);
+    if (!control) {
+        _segments.push_back(segment);
+    } else {
+        _segments.insert(_segments.begin() + _head + _front, segment);
+        ++_front;
+    }
+    if (_replayLimit != 0 && size() > _replayLimit) {
+        dropFront(1);
+    }
+}
+
+void ReplyQueue::push_back(const std::string &reply) {
+    OutputSegment segment;
+
+    if (reply.empty()) {
+        return;
+    }
+    notify();
+    if (reply.size() > OutputBuffer::CHUNK_SIZE) {
+        segment.buffer = OutputBuffer::create(reply);
+        segment.offset = 0;
+    } else {
+        if (_tail == NULL || _tail->space() < reply.size()) {
+            if (_tail != NULL) {
+                _tail->release();
+            }
+            _tail = OutputBuffer::chunk();
+        }
+        _tail->retain();
+        segment.buffer = _tail;
+        segment.offset = _tail->size();
+        _tail->append(reply.data(), reply.size());
+    }
+    segment.length = reply.size();
+    insert(segment, _reorder && isControlReply(reply));
+}
+
+void ReplyQueue::pushShared(OutputBuffer *buffer) {
+    OutputSegment segment;
+
+    if (buffer->size() == 0) {
+        return;
+    }
+    notify();
+    buffer->retain();
+    segment.buffer = buffer;
+    segment.offset = 0;
+    segment.length = buffer->size();
+    insert(segment, false);
+}
+
+void ReplyQueue::append(ReplyQueue &other) {
+    if (other.empty()) {
+        return;
+    }
+    notify();
+    _segments.insert(_segments.end(), other._segments.begin() + other._head, other._segments.end());
+    addBytes(other._bytes);
+    checkLimit(other._bytes);
+    // the segments changed hands along with their references
+    other.removeBytes(other._bytes);
+    other._segments.clear();
+    other._head = 0;
+    other._front = 0;
+    other._started = false;
+}
+
+void ReplyQueue::logSent(const OutputSegment &segment) const {
+    std::cout << "............................................" << std::endl;
+    std::cout << "Sending message to client " << (_owner ? _owner->getNickname() : std::string()) << ": ";
+    std::cout.write(segment.buffer->data() + segment.offset, segment.length);
+    std::cout << std::endl;
+    std::cout << "............................................" << std::endl;
+}
+
+void ReplyQueue::popFront(void) {
+    _segments[_head].buffer->release();
+    ++_head;
+    _started = false;
+    if (_front > 0) {
+        --_front;
+    }
+    if (empty()) {
+        _segments.clear();
+        _head = 0;
+        if (_tail != NULL) {
+            _tail->release();
+            _tail = NULL;
+        }
+    } else if (_head * 2 >= _segments.size()) {
+        _segments.erase(_segments.begin(), _segments.begin() + _head);
+        _head = 0;
+    }
+}
+
+void ReplyQueue::dropFront(std::size_t count) {
+    for (; count > 0 && !empty(); --count) {
+        removeBytes(_segments[_head].length);
+        popFront();
+    }
+}
+
+// A line the socket had started on is meaningless to anyone but that
+// connection, so it is not kept for replay
+void ReplyQueue::dropStarted(void) {
+    if (_started) {
+        dropFront(1);
+    }
+}
+
+void ReplyQueue::clear(void) {
+    dropFront(size());
+    if (_tail != NULL) {
+        _tail->release();
+        _tail = NULL;
+    }
+}
+
+void ReplyQueue::shrink(void) {
+    if (empty() && _segments.capacity() > 0) {
+        std::vector<OutputSegment>().swap(_segments);
+    }
+}
+
+std::size_t ReplyQueue::heapBytes(void) const {
+    if (_segments.capacity() == 0) {
+        return 0;
+    }
+    return MemoryAccount::block(_segments.capacity() * sizeof(OutputSegment));
+}
+
+int ReplyQueue::fill(struct iovec *iov, int max) const {
+    int count = 0;
+
+    for (std::size_t i = _head; i < _segments.size() && count < max; ++i, ++count) {
+        iov[count].iov_base = const_cast<char *>(_segments[i].buffer->data() + _segments[i].offset);
+        iov[count].iov_len = _segments[i].length;
+    }
+    return count;
+}
+
+void ReplyQueue::consume(std::size_t bytes) {
+    removeBytes(bytes);
+    while (bytes > 0) {
+        OutputSegment &segment = _segments[_head];
+        if (bytes < segment.length) {
+            segment.offset += bytes;
+            segment.length -= bytes;
+            if (!_started && _front == 0) {
+                _front = 1;
+            }
+            _started = true;
+            return;
+        }
+        bytes -= segment.length;
+        logSent(segment);
+        popFront();
+    }
+}
+
+void ReplyQueue::retainFront(std::size_t bytes, std::vector<OutputBuffer *> &pins) const {
+    for (std::size_t i = _head; i < _segments.size() && bytes > 0; ++i) {
+        _segments[i].buffer->retain();
+        pins.push_back(_segments[i].buffer);
+        bytes -= std::min<std::size_t>(bytes, _segments[i].length);
+    }
+}
+
+void ReplyQueue::moveTo(std::string &out, std::size_t count) {
+    for (; count > 0 && !empty(); --count) {
+        const OutputSegment &segment = _segments[_head];
+        out.append(segment.buffer->data() + segment.offset, segment.length);
+        logSent(segment);
+        removeBytes(segment.length);
+        popFront();
+    }
+}
@@ -0,0 +1,38 @@
+#include "../Includes/ReplyTemplate.hpp"
+#include <algorithm>
+
+ReplyTemplate::ReplyTemplate(void) : _literalSize(0) {
+    return;
+}
+
+void ReplyTemplate::compile(const std::string &formatted) {
+    std::size_t start = 0;
+    std::size_t marker;
+
+    _literals.clear();
+    _fields.clear();
+    _literalSize = 0;
+    while ((marker = formatted.find('\x01', start)) != std::string::npos && marker + 1 < formatted.size()) {
+        _literals.push_back(formatted.substr(start, marker - start));
+        _literalSize += marker - start;
+        _fields.push_back(formatted[marker + 1] == 'N' ? FIELD_NICK : FIELD_USER);
+        start = marker + 2;
+    }
+    _literals.push_back(formatted.substr(start));
+    _literalSize += formatted.size() - start;
+}
+
+std::string ReplyTemplate::render(const std::string &nickname, const std::string &username) const {
+    std::string reply;
+
+    if (_literals.empty()) {
+        return reply;
+    }
+    reply.reserve(_literalSize + _fields.size() * std::max(nickname.size(), username.size()));
+    for (std::size_t i = 0; i < _fields.size(); ++i) {
+        reply += _literals[i];
+        reply += (_fields[i] == FIELD_NICK) ? nickname : username;
+    }
+    reply += _literals.back();
+    return reply;
+}
@@ -0,0 +1,110 @@
+#include "../Includes/Server.hpp"
+#include <iterator>
+
+static std::string randomToken(void)
+{
+    static const char hex[] = "0123456789abcdef";
+    unsigned char bytes[16];
+    std::string token;
+    std::ifstream urandom("/dev/urandom", std::ios::in | std::ios::binary);
+
+    if (!urandom.read(reinterpret_cast<char *>(bytes), sizeof(bytes))) {
+        for (std::size_t i = 0; i < sizeof(bytes); ++i) {
+            bytes[i] = static_cast<unsigned char>(std::rand());
+        }
+    }
+    for (std::size_t i = 0; i < sizeof(bytes); ++i) {
+        token += hex[bytes[i] >> 4];
+        token += hex[bytes[i] & 0x0F];
+    }
+    return token;
+}
+
+void Server::issueResumeToken(Client *client) {
+    client->setResumeToken(randomToken());
+    client->serverReplies.push_back(RPL_RESUMETOKEN(client->getResumeToken()));
+}
+
+// Called when a registered client's connection drops. The Client stays in
+// its channels with its nick reserved; broadcasts keep queueing on it.
+bool Server::detachSession(Client *client) {
+    int clientFd = client->getFd();
+
+    if (!client->isFullyRegistered() || client->getResumeToken().empty()) {
+        return false;
+    }
+    cancelClientTasks(clientFd);
+    _clients.erase(clientFd);
+    closeClientSocket(client);
+    _deferredRegistrations.erase(clientFd);
+    client->consumeOutput(client->getOutBuffer().size());
+    client->serverReplies.dropStarted();
+    client->serverReplies.detach(RESUME_REPLAY_LINES);
+    client->setFd(-1);
+    client->setDetached(true);
+
+    DetachedSession &session = _detachedSessions[client->getResumeToken()];
+    session.client = client;
+    session.expiry = _sessionExpiries.insert(std::make_pair(ft_monotonicUsec() + RESUME_GRACE_PERIOD * 1000000LL,
+                                                            client->getResumeToken()));
+    std::cout << "Session of " << client->getNickname() << " detached for "
+              << RESUME_GRACE_PERIOD << "s" << std::endl;
+    return true;
+}
+
+// RESUME <token>, sent in place of NICK/USER. The new connection takes the
+// detached session's identity and channel memberships without any JOIN,
+// NAMES or QUIT traffic, and receives what was queued while it was away.
+int Server::resumeSession(Client *client, const ParseMessage &parsedMsg) {
+    const ScratchVector<std::string> &params = parsedMsg.getParams();
+    std::map<std::string, DetachedSession>::iterator found;
+
+    if (params.empty() || (found = _detachedSessions.find(params[0])) == _detachedSessions.end()) {
+        client->serverReplies.push_back(ERR_RESUMEFAIL(std::string("INVALID_TOKEN"), std::string("Cannot resume session")));
+        return 0;
+    }
+    if (client->getRegistration() & (REG_NICK | REG_USER)) {
+        client->serverReplies.push_back(ERR_RESUMEFAIL(std::string("REGISTRATION_IS_COMPLETED"), std::string("Too late to resume")));
+        return 0;
+    }
+
+    Client *detached = found->second.client;
+    _sessionExpiries.erase(found->second.expiry);
+    _detachedSessions.erase(found);
+
+    client->setNickname(detached->getNickname());
+    _nicknames[ChannelTable::fold(client->getNickname())] = client;
+    client->setUsername(detached->getUsername());
+    client->setHostname(detached->getHostname());
+    const std::set<std::string> *channelSets[] = { &detached->getMemberships(), &detached->getInvites() };
+    for (std::size_t i = 0; i < 2; ++i) {
+        for (std::set<std::string>::const_iterator it = channelSets[i]->begin(); it != channelSets[i]->end(); ++it) {
+            Channel *chan = _channels.find(*it);
+            if (chan != NULL) {
+                chan->replaceClient(detached, client);
+            }
+        }
+    }
+    client->setResumed(true);
+    client->serverReplies.push_back(RPL_RESUMESUCCESS(client->getNickname()));
+    client->serverReplies.append(detached->serverReplies);
+    ++_resumes;
+    std::cout << "Session of " << client->getNickname() << " resumed on fd " << client->getFd() << std::endl;
+    delete detached;
+    return REG_NICK | REG_USER;
+}
+
+// Only sessions that are due are looked at; the replay limit is kept by
+// each detached queue as replies arrive
+void Server::expireDetachedSessions(long long now) {
+    while (!_sessionExpiries.empty() && _sessionExpiries.begin()->first <= now) {
+        std::map<std::string, DetachedSession>::iterator it = _detachedSessions.find(_sessionExpiries.begin()->second);
+        Client *client = it->second.client;
+
+        _sessionExpiries.erase(_sessionExpiries.begin());
+        _detachedSessions.erase(it);
+        std::cout << "Session of " << client->getNickname() << " expired" << std::endl;
+        teardownClient(client, "Session expired");
+        ++_resumesExpired;
+    }
+}
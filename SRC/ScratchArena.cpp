@@ -0,0 +1,67 @@
+#include "../Includes/ScratchArena.hpp"
+#include "../Includes/MemoryStats.hpp"
+
+ScratchArena ScratchArena::instance;
+
+// every allocation keeps the alignment operator new would give it
+static std::size_t aligned(std::size_t bytes)
+{
+    return (bytes + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+}
+
+ScratchArena::ScratchArena(void) : _current(0),
+                                  _used(0),
+                                  _depth(0),
+                                  _bytes(0) {
+    return;
+}
+
+ScratchArena::~ScratchArena(void) {
+    for (std::size_t i = 0; i < _blocks.size(); ++i) {
+        MemoryAccount::release(MEM_PARSER, MemoryAccount::block(_blocks[i].size));
+        delete[] _blocks[i].data;
+    }
+    return;
+}
+
+// Moves on to the next kept block that fits, allocating one only when
+// none does; an oversized request gets a block of its own size
+void ScratchArena::nextBlock(std::size_t bytes) {
+    for (std::size_t i = _blocks.empty() ? 0 : _current + 1; i < _blocks.size(); ++i) {
+        if (_blocks[i].size >= bytes) {
+            _current = i;
+            _used = 0;
+            return;
+        }
+    }
+    Block block;
+    block.size = bytes > BLOCK_SIZE ? bytes : BLOCK_SIZE;
+    block.data = new char[block.size];
+    _blocks.push_back(block);
+    _bytes += block.size;
+    MemoryAccount::allocate(MEM_PARSER, MemoryAccount::block(block.size));
+    _current = _blocks.size() - 1;
+    _used = 0;
+}
+
+void *ScratchArena::allocate(std::size_t bytes) {
+    bytes = aligned(bytes);
+    if (_blocks.empty() || _used + bytes > _blocks[_current].size) {
+        nextBlock(bytes);
+    }
+    void *address = _blocks[_current].data + _used;
+    _used += bytes;
+    return address;
+}
+
+void ScratchArena::deallocate(void *address, std::size_t bytes) {
+    bytes = aligned(bytes);
+    if (!_blocks.empty() && static_cast<char *>(address) + bytes == _blocks[_current].data + _used) {
+        _used -= bytes;
+    }
+}
+
+void ScratchArena::reset(void) {
+    _current = 0;
+    _used = 0;
+}
@@ -1,6 +1,7 @@
 #include "../Includes/Server.hpp"
 
-bool signalInterrupt = false;
+volatile sig_atomic_t signalInterrupt = false;
+volatile sig_atomic_t filterReload = false;
 
 Server* Server::getInstance(void) {
     if (!Server::_instance)
@@ -9,12 +10,15 @@ Server* Server::getInstance(void) {
 }
 
 void Server::initServer(void) {
+    raiseDescriptorLimit();
+
     _listeningSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     if (_listeningSocket == -1) {
         throw IrcException("Can't create a socket!");
     }
 
     if (fcntl(_listeningSocket, F_SETFL, O_NONBLOCK) == -1) {
+        close(_listeningSocket);
         throw IrcException("Can't set file descriptor flags");
     }
 
@@ -34,7 +38,7 @@ void Server::initServer(void) {
         throw IrcException("Can't bind to IP/port");
     }
 
-    if (listen(_listeningSocket, 1) == -1) {
+    if (listen(_listeningSocket, SOMAXCONN) == -1) {
         perror("listen");
         close(_listeningSocket);
         throw IrcException("Can't listen!");
@@ -46,16 +50,45 @@ void Server::initServer(void) {
     std::cout << "IRC server Listening on " << _host << " on port " << _serverPort << std::endl;
     std::cout << "Waiting for incoming connections..." << std::endl;
 
-    pollfd listeningSocketPoll;
-    memset(&listeningSocketPoll, 0, sizeof(listeningSocketPoll));
-    listeningSocketPoll.fd = _listeningSocket;
-    listeningSocketPoll.events = POLLIN;
-    listeningSocketPoll.revents = 0;
-    _fds.push_back(listeningSocketPoll);
+    reloadSpamFilter();
+    loadWelcomeTemplate();
+    loadPriorityAddresses();
+
+    _clients.reserve(_descriptorLimit);
+    _fds.reserve(_descriptorLimit);
+    _pollSlots.reserve(_descriptorLimit);
+    _clients.setKind(_listeningSocket, FD_LISTENER);
+    appendPollFd(_listeningSocket, POLLIN);
+
+    initAdminSocket();
+#ifdef IRC_COROUTINES
+    startHostResolver();
+#endif
 
     return;
 }
 
+void Server::raiseDescriptorLimit(void) {
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == -1) {
+        throw IrcException("Can't read the descriptor limit");
+    }
+    rlim_t wanted = (limit.rlim_max == RLIM_INFINITY || limit.rlim_max > MAX_DESCRIPTORS)
+        ? MAX_DESCRIPTORS : limit.rlim_max;
+    if (limit.rlim_cur < wanted) {
+        limit.rlim_cur = wanted;
+        if (setrlimit(RLIMIT_NOFILE, &limit) == -1) {
+            perror("setrlimit");
+            getrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
+    _descriptorLimit = (limit.rlim_cur > MAX_DESCRIPTORS) ? MAX_DESCRIPTORS : limit.rlim_cur;
+    std::cout << "Descriptor limit: " << _descriptorLimit << std::endl;
+
+    _spareFd = open("/dev/null", O_RDONLY);
+}
+
 void Server::signalHandler(int signal) {
     std::cerr << "Interrupt Signal (" << signal << ") received, Shutting down the Server..." << std::endl;
     signalInterrupt = true;
@@ -63,40 +96,104 @@ void Server::signalHandler(int signal) {
     return;
 }
 
+void Server::reloadHandler(int signal) {
+    (void)signal;
+    filterReload = true;
+
+    return;
+}
+
 void Server::runServer(void) {
     signal(SIGTSTP, signalHandler);
     signal(SIGINT, signalHandler);
     signal(SIGQUIT, signalHandler);
+    signal(SIGHUP, reloadHandler);
+    // A peer that reset its connection shows up as EPIPE from send()
+    // and is torn down when its read fails, not by killing the server
+    signal(SIGPIPE, SIG_IGN);
 
+    _lastMetrics = ft_monotonicUsec();
+    _lastAdmission = _lastMetrics;
     while (signalInterrupt == false) {
-        if (poll((&_fds[0]), _fds.size(), 1000) == -1) {
+        if (filterReload == true) {
+            filterReload = false;
+            reloadSpamFilter();
+            loadWelcomeTemplate();
+            loadPriorityAddresses();
+        }
+
+        // Paused accepts leave new connections waiting in the backlog
+        _fds[0].events = (_overloadLevel >= LOAD_PAUSE_ACCEPT) ? 0 : POLLIN;
+        if (poll((&_fds[0]), _fds.size(), pollTimeout()) == -1) {
+            // SIGHUP (filter reload) interrupts poll without ending the loop
+            if (errno == EINTR) {
+                continue;
+            }
             cleanupServer();
             perror("poll");
             throw IrcException("Poll error");
         }
+        long long iterationStart = ft_monotonicUsec();
+        ++_iterations;
 
         if (_fds[0].revents & POLLIN) {
-            handleNewConnection();
+            for (int accepted = 0; accepted < ACCEPT_BATCH && handleNewConnection(); ++accepted)
+                ;
         }
 
-        std::vector<pollfd>::iterator it = _fds.begin();
-        while (it != _fds.end()) {
-            if (it->fd != _listeningSocket && it->revents & POLLIN) {
-                try {
+        // Entries are never removed or moved here: closing an fd only
+        // releases its slot, and compactPollFds() runs after the loop
+        for (std::size_t slot = 0; slot < _fds.size(); ++slot) {
+            pollfd *it = &_fds[slot];
+            FdKind kind = _clients.kindOf(it->fd);
+            if (kind == FD_ADMIN) {
+                handleAdminEvent(*it);
+            } else if (kind == FD_LOOKUP) {
+                completeHostLookup(*it);
+            } else if (kind == FD_DRAIN) {
+                drainZeroCopy(*it);
+            } else if (kind == FD_CLIENT) {
+                if (it->revents & POLLERR) {
+                    reapZeroCopyCompletions(it->fd);
+                }
+                // A client with lines still waiting on the ready list is
+                // not read from, so its backlog stays in the socket buffer
+                Client *client = _clients.find(it->fd);
+                if ((it->revents & POLLIN) && !client->isReady() && !client->isClosing()) {
                     handleClientMessage(it->fd);
-                } catch (...) {
-                    it->fd = -1;
                 }
-            } else if (it->fd != _listeningSocket && it->revents & POLLOUT) {
-                sendToClient(it->fd);
-            }
-
-            if (it->fd == -1) {
-                closeClient(it->fd);
-            } else {
-                ++it;
+                // Not an else: a client that sends every iteration would
+                // never have its backed-up output written. Its queue is
+                // already non-empty, so flushPendingReplies() won't see it.
+                client = _clients.find(it->fd);
+                if ((it->revents & POLLOUT) && client != NULL && !client->isClosing()) {
+                    sendToClient(it->fd);
+                }
+                // New replies are flushed at the end of the iteration;
+                // POLLOUT is only wanted while the socket is full
+                if (client != NULL && !client->hasPendingOutput()) {
+                    it->events = POLLIN;
+                }
             }
         }
+        processReadyClients();
+
+        long long now = ft_monotonicUsec();
+        _busyMicros += now - iterationStart;
+        admitRegistrations(now);
+        updateOverload(now, now - iterationStart);
+        expireDetachedSessions(now);
+        enforceSendQueues();
+        processPendingCloses();
+        if (!_zeroCopyDrains.empty()) {
+            expireZeroCopyDrains(now);
+        }
+        compactPollFds();
+        flushPendingReplies();
+        hibernateIdleClients(now);
+        if (now - _lastMetrics >= METRICS_INTERVAL * 1000000LL) {
+            reportMetrics(now);
+        }
     }
 
     cleanupServer();
@@ -104,34 +201,60 @@ void Server::runServer(void) {
 }
 
 void Server::sendToClient(int client_fd) {
-    Client* client = _clients[client_fd];
-    std::vector<std::string>::iterator it = client->serverReplies.begin();
-
-    for (; it != client->serverReplies.end(); ++it) {
-        std::cout << "............................................" << std::endl;
-        std::cout << "Sending message to client " << client->getNickname() << ": " << *it << std::endl;
-        std::cout << "............................................" << std::endl;
-        if (send(client_fd, it->c_str(), it->size(), 0) == -1) {
-            std::cerr << "Error sending message to client " << client->getNickname() << " (" << strerror(errno) << ")" << std::endl;
+    Client* client = _clients.find(client_fd);
+
+    // A compressed stream is deflated into one buffer first. Send until the
+    // socket is full; whatever it doesn't take waits for the next POLLOUT.
+    client->flushReplies(_compressionLevel);
+    while (client->hasPendingOutput()) {
+        ssize_t bytesSent = sendOutput(client);
+        if (bytesSent <= 0) {
+            if (bytesSent == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "Error sending message to client " << client->getNickname() << " (" << strerror(errno) << ")" << std::endl;
+            }
+            // a DEFLATE stream backs up in _outBuffer, not in the queue
+            if (client->pendingBytes() > ReplyQueue::SENDQ_MAX && !client->isClosing()) {
+                ReplyQueue::overflowed.push_back(client->getHandle());
+            }
             return;
         }
     }
-
-    client->serverReplies.clear();
+    client->trimBuffers();
 
     return;
 }
 
-void Server::handleNewConnection(void) {
+bool Server::handleNewConnection(void) {
     sockaddr_in clientHint;
     socklen_t clientSize = sizeof(clientHint);
     int clientSocket = accept(_listeningSocket, (sockaddr*)&clientHint, &clientSize);
     if (clientSocket == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return false;
+        }
+        if (errno == EMFILE || errno == ENFILE) {
+            rejectConnection();
+            return false;
+        }
+        // the peer gave up before we got to it; the next one may be fine
+        if (errno == ECONNABORTED || errno == EINTR) {
+            return true;
+        }
         perror("accept");
         throw IrcException("Can't accept client connection");
     }
+    // A blocking socket would stall the whole loop on one slow reader
+    // instead of letting its output queue up
+    if (fcntl(clientSocket, F_SETFL, O_NONBLOCK) == -1) {
+        perror("fcntl");
+        close(clientSocket);
+        return true;
+    }
 
-    int result = getnameinfo((sockaddr*)&clientHint, clientSize, _host, NI_MAXHOST, _svc, NI_MAXSERV, 0);
+    // Numeric only: a reverse lookup here would block the loop for every
+    // connection accepted. The coroutine build resolves the name on the
+    // host resolver once the user registers.
+    int result = getnameinfo((sockaddr*)&clientHint, clientSize, _host, NI_MAXHOST, _svc, NI_MAXSERV, NI_NUMERICHOST | NI_NUMERICSERV);
     if (result) {
         std::cout << _host << " connected on " << _svc << std::endl;
     } else {
@@ -140,43 +263,57 @@ void Server::handleNewConnection(void) {
     }
 
     Client* tmpClient = new Client(clientSocket);
-    _clients[clientSocket] = tmpClient;
+    _clients.insert(clientSocket, tmpClient);
+    tmpClient->setAddress(clientHint);
+    applyPriority(tmpClient);
+    tmpClient->enableZeroCopy();
 
-    pollfd clientPoll;
-    memset(&clientPoll, 0, sizeof(clientPoll));
-    clientPoll.fd = clientSocket;
-    clientPoll.events = POLLIN | POLLOUT;
-    clientPoll.revents = 0;
-    _fds.push_back(clientPoll);
+    appendPollFd(clientSocket, POLLIN);
 
-    return;
+    return true;
+}
+
+// Out of descriptors: the pending connection would keep the listener
+// readable, and poll() would return at once on every iteration. Give up
+// the spare fd for long enough to accept that connection and close it.
+void Server::rejectConnection(void) {
+    if (_spareFd == -1) {
+        return;
+    }
+    close(_spareFd);
+    int clientSocket = accept(_listeningSocket, NULL, NULL);
+    if (clientSocket != -1) {
+        close(clientSocket);
+        ++_rejectedConnections;
+        std::cerr << "Out of file descriptors, connection refused" << std::endl;
+    }
+    _spareFd = open("/dev/null", O_RDONLY);
 }
 
 int Server::ft_recv(int fd) {
-    _message.clear();
-    _message.resize(BUFFER_SIZE);
-    int bytesRecv = recv(fd, &_message[0], BUFFER_SIZE, 0);
+    char buffer[BUFFER_SIZE];
+    int bytesRecv = recv(fd, buffer, readBudget(), 0);
     if (bytesRecv <= 0) {
         return bytesRecv;
     }
 
-    _message.resize(bytesRecv);
+    _message.assign(buffer, bytesRecv);
 
     return bytesRecv;
 }
 
 void Server::handleClientDisconnection(int client_fd, int bytesRecv) {
+    std::string reason = (bytesRecv == 0) ? "Connection closed" : strerror(errno);
+
     if (bytesRecv == 0) {
         std::cout << "Client " << client_fd << " disconnected" << std::endl;
     } else {
-        std::cerr << "Error receiving message from client " << client_fd << " (" << strerror(errno) << ")" << std::endl;
+        std::cerr << "Error receiving message from client " << client_fd << " (" << reason << ")" << std::endl;
     }
 
-    for (std::vector<pollfd>::iterator it = _fds.begin(); it != _fds.end(); ++it) {
-        if (it->fd == client_fd) {
-            it->fd = -1;
-            break;
-        }
+    Client *client = _clients.find(client_fd);
+    if (client != NULL) {
+        scheduleClose(client, reason, true);
     }
     return;
 }
@@ -189,60 +326,232 @@ void Server::handleClientMessage(int client_fd) {
         return;
     }
 
-    _clients[client_fd]->appendToBuffer(_message);
-    
-    std::string& buffer = _clients[client_fd]->getBuffer();
-    std::vector<std::string> commandList;
+    Client *client = _clients.find(client_fd);
+    client->touch();
+    client->appendToBuffer(_message);
+    processBufferedLines(client);
+    if (!client->isFullyRegistered() && client->getBuffer().size() > UNREGISTERED_INPUT_MAX) {
+        scheduleClose(client, "Input buffer exceeded", false);
+    }
+    client->trimBuffers();
+
+    return;
+}
+
+void Server::processBufferedLines(Client *client) {
+    // parsed params and split lists of this batch are dropped in one go
+    ScratchArena::Scope scratch;
+    std::string& buffer = client->getBuffer();
     size_t pos;
+    int lines = 0;
+    std::size_t bytes = 0;
+
+    // A suspended handler keeps the rest of the buffer queued until it
+    // finishes, so commands still run in the order the client sent them
+    while (!client->isClosing() && !client->isSuspended() && !deferRegistration(client)
+           && (pos = buffer.find('\n')) != std::string::npos) {
+        if (READ_BUDGET && (lines == LINES_PER_ROUND * client->getPriority()
+                            || bytes >= BYTES_PER_ROUND * client->getPriority())) {
+            if (!client->isReady()) {
+                client->setReady(true);
+                _readyClients.push_back(client->getHandle());
+                ++_budgetDeferrals;
+            }
+            return;
+        }
+        ++lines;
+        bytes += pos + 1;
 
-    while ((pos = buffer.find('\n')) != std::string::npos) {
         std::string completeCommand = buffer.substr(0, pos + 1);
         
         buffer.erase(0, pos + 1);
+
+        // Validate once here so invalid bytes never reach a channel fan-out
+        if (UTF8_ONLY && !isValidUtf8(completeCommand)) {
+            if (!UTF8_REPLACE) {
+                // the command name is echoed only if it is itself clean
+                std::string command = ParseMessage(completeCommand).getCmd();
+                if (command.empty() || !isValidUtf8(command)) {
+                    command = "*";
+                }
+                client->serverReplies.push_back(ERR_INVALIDUTF8(command));
+                continue;
+            }
+            completeCommand = sanitizeUtf8(completeCommand);
+        }
         
-        std::cout << "Received complete command from client " << _clients[client_fd]->getNickname() 
+        std::cout << "Received complete command from client " << client->getNickname() 
                  << ": " << completeCommand;
         
-        ParseMessage parsedMsg(completeCommand);
-        processCommand(_clients[client_fd], parsedMsg);
+        ParseMessage parsedMsg(std::move(completeCommand));
+        // a handler that fails outright only loses its own client
+        try {
+            if (processCommand(client, parsedMsg) == COMMAND_CLOSE) {
+                break;
+            }
+        } catch (const std::exception &e) {
+            std::cerr << "Command failed for client " << client->getFd() << ": " << e.what() << std::endl;
+            scheduleClose(client, "Connection error", false);
+            break;
+        }
     }
 
     return;
 }
 
-void Server::closeClient(int client_fd) {
-    std::map<int, Client*>::iterator it = _clients.find(client_fd);
-    if (it != _clients.end()) {
-        close(client_fd);
-        delete it->second;
-        _clients.erase(it);
+// One more round for every client that ran out of budget, high priority
+// clients first. Those still over it queue themselves again for the next
+// iteration.
+void Server::processReadyClients(void) {
+    std::deque<ClientHandle> ready;
+    const ClientPriority order[] = { PRIORITY_HIGH, PRIORITY_NORMAL };
+
+    ready.swap(_readyClients);
+    for (std::size_t pass = 0; pass < 2; ++pass) {
+        for (std::deque<ClientHandle>::iterator it = ready.begin(); it != ready.end(); ++it) {
+            Client *client = resolveClient(*it);
+            if (client == NULL || !client->isReady() || client->getPriority() != order[pass]) {
+                continue;
+            }
+            client->setReady(false);
+            processBufferedLines(client);
+        }
     }
+}
+
+// Sends what was queued this iteration straight away. Only clients whose
+// socket could not take all of it are polled for POLLOUT.
+void Server::flushPendingReplies(void) {
+    std::vector<ClientHandle> pending;
 
-    for (std::vector<pollfd>::iterator it = _fds.begin(); it != _fds.end();) {
-        if (it->fd == client_fd) {
-            it = _fds.erase(it);
-        } else {
-            ++it;
+    pending.swap(ReplyQueue::pending);
+    for (std::vector<ClientHandle>::iterator it = pending.begin(); it != pending.end(); ++it) {
+        Client *client = resolveClient(*it);
+        if (client == NULL || !client->hasPendingOutput()) {
+            continue;
+        }
+        sendToClient(it->fd);
+        pollfd *entry = findPollFd(it->fd);
+        if (entry != NULL && client->hasPendingOutput()) {
+            entry->events = POLLIN | POLLOUT;
         }
     }
 }
 
+// A client that stopped reading is dropped once its output passes
+// SENDQ_MAX, instead of holding the server's memory hostage
+void Server::enforceSendQueues(void) {
+    std::vector<ClientHandle> overflowed;
+
+    overflowed.swap(ReplyQueue::overflowed);
+    for (std::vector<ClientHandle>::iterator it = overflowed.begin(); it != overflowed.end(); ++it) {
+        Client *client = resolveClient(*it);
+        if (client == NULL || client->pendingBytes() <= ReplyQueue::SENDQ_MAX) {
+            continue;
+        }
+        std::cout << "Client " << client->getFd() << " (" << client->getNickname() << ") exceeded its send queue: "
+                  << client->pendingBytes() << " bytes" << std::endl;
+        scheduleClose(client, "SendQ exceeded", false);
+    }
+}
+
+int Server::pollTimeout(void) const {
+    if (!_readyClients.empty()) {
+        return 0;
+    }
+    // Wake up soon enough to keep admitting queued registrations
+    return pendingAdmissions() ? 10 : 1000;
+}
+
+void Server::addPollFd(int fd, short events) {
+    pollfd entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.fd = fd;
+    entry.events = events;
+    entry.revents = 0;
+    _deferredFds.push_back(entry);
+}
+
+void Server::appendPollFd(int fd, short events) {
+    pollfd entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.fd = fd;
+    entry.events = events;
+    entry.revents = 0;
+    if (static_cast<std::size_t>(fd) >= _pollSlots.size()) {
+        _pollSlots.resize(fd + 1, -1);
+    }
+    _pollSlots[fd] = static_cast<int>(_fds.size());
+    _fds.push_back(entry);
+}
+
+pollfd *Server::findPollFd(int fd) {
+    if (fd < 0 || static_cast<std::size_t>(fd) >= _pollSlots.size() || _pollSlots[fd] == -1) {
+        return NULL;
+    }
+    return &_fds[_pollSlots[fd]];
+}
+
+// Once per iteration: every released slot is filled from the back of
+// _fds, so N closes cost O(N) however large the array is. Released
+// entries left at the back are popped first, so the one moved down is
+// always live. The listener stays in slot 0 as it is never released.
+void Server::compactPollFds(void) {
+    for (std::vector<int>::iterator it = _releasedSlots.begin(); it != _releasedSlots.end(); ++it) {
+        while (!_fds.empty() && _fds.back().fd == -1) {
+            _fds.pop_back();
+        }
+        std::size_t slot = *it;
+        if (slot >= _fds.size()) {
+            continue;
+        }
+        _fds[slot] = _fds.back();
+        _pollSlots[_fds[slot].fd] = static_cast<int>(slot);
+        _fds.pop_back();
+    }
+    _releasedSlots.clear();
+
+    for (std::vector<pollfd>::iterator it = _deferredFds.begin(); it != _deferredFds.end(); ++it) {
+        appendPollFd(it->fd, it->events);
+    }
+    _deferredFds.clear();
+}
+
 std::string Server::getServerPassword(void) {
     return _serverPassword;
 }
 
 void Server::cleanupServer(void) {
     std::cout << "Cleaning up server..." << std::endl;
+#ifdef IRC_COROUTINES
+    stopHostResolver();
+#endif
     for (std::vector<pollfd>::iterator it = _fds.begin(); it != _fds.end(); ++it)
-        close(it->fd);
+        if (it->fd != -1)
+            close(it->fd);
+
+    for (int fd = _clients.next(-1); fd != -1; fd = _clients.next(fd))
+        delete _clients.find(fd);
+    for (std::map<std::string, DetachedSession>::iterator it = _detachedSessions.begin(); it != _detachedSessions.end(); ++it)
+        delete it->second.client;
+    _detachedSessions.clear();
+    _sessionExpiries.clear();
+    OutputBuffer::releasePool();
+
+    delete _spamFilter;
+    _spamFilter = NULL;
+
+    if (_adminSocket != -1) {
+        unlink(ADMIN_SOCKET_PATH);
+    }
 
-    for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it)
-        delete it->second;
+    if (_spareFd != -1) {
+        close(_spareFd);
+    }
 
     shutdown(_listeningSocket, SHUT_RDWR);
     close(_listeningSocket);
     _fds.clear();
-    _clients.clear();
     delete Server::_instance;
     exit(0);
 }
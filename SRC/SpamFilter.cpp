@@ -0,0 +1,301 @@
+#include "../Includes/Server.hpp"
+#include "../Includes/SpamFilter.hpp"
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+# include <arm_neon.h>
+#endif
+
+SpamFilter::SpamFilter(void) : _rangeCount(0), _classCount(1) {
+    memset(_classOf, 0, sizeof(_classOf));
+    memset(_startByte, 0, sizeof(_startByte));
+    _delta.assign(1, 0);
+    _output.assign(1, ACTION_NONE);
+    _outputPattern.assign(1, -1);
+    return;
+}
+
+SpamFilter::Action SpamFilter::parseAction(const std::string &name) {
+    if (name == "block")
+        return ACTION_BLOCK;
+    if (name == "tag")
+        return ACTION_TAG;
+    if (name == "log")
+        return ACTION_LOG;
+    return ACTION_NONE;
+}
+
+bool SpamFilter::loadFromFile(const std::string &path) {
+    std::ifstream infile(path.c_str(), std::ios::in);
+    std::string line;
+    int lineNumber = 0;
+
+    if (!infile.is_open()) {
+        return false;
+    }
+
+    while (std::getline(infile, line)) {
+        ++lineNumber;
+        std::size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+
+        std::size_t split = line.find_first_of(" \t", start);
+        std::size_t patternStart = (split == std::string::npos) ? split : line.find_first_not_of(" \t", split);
+        std::size_t patternEnd = line.find_last_not_of(" \t\r");
+        Action action = parseAction(line.substr(start, split - start));
+
+        if (action == ACTION_NONE || patternStart == std::string::npos) {
+            std::cerr << path << ":" << lineNumber << ": expected \"<block|tag|log> <pattern>\"" << std::endl;
+            continue;
+        }
+        addPattern(line.substr(patternStart, patternEnd - patternStart + 1), action);
+    }
+    infile.close();
+    compile();
+    return true;
+}
+
+bool SpamFilter::addPattern(const std::string &pattern, Action action) {
+    if (pattern.empty() || action == ACTION_NONE) {
+        return false;
+    }
+    _patterns.push_back(pattern);
+    _actions.push_back(action);
+    return true;
+}
+
+void SpamFilter::compile(void) {
+    // Matching is ASCII case-insensitive: both cases share one class.
+    memset(_classOf, 0, sizeof(_classOf));
+    memset(_startByte, 0, sizeof(_startByte));
+    _classCount = 1;
+    for (std::size_t p = 0; p < _patterns.size(); ++p) {
+        for (std::size_t i = 0; i < _patterns[p].size(); ++i) {
+            unsigned char c = std::tolower(static_cast<unsigned char>(_patterns[p][i]));
+            if (_classOf[c] == 0 && _classCount < 256) {
+                _classOf[c] = static_cast<unsigned char>(_classCount++);
+            }
+        }
+    }
+    for (int c = 'A'; c <= 'Z'; ++c) {
+        _classOf[c] = _classOf[std::tolower(c)];
+    }
+
+    // Build the trie, -1 marks a missing edge.
+    _delta.assign(_classCount, -1);
+    _output.assign(1, ACTION_NONE);
+    _outputPattern.assign(1, -1);
+    for (std::size_t p = 0; p < _patterns.size(); ++p) {
+        int state = 0;
+        for (std::size_t i = 0; i < _patterns[p].size(); ++i) {
+            int c = _classOf[static_cast<unsigned char>(_patterns[p][i])];
+            int &next = _delta[state * _classCount + c];
+            if (next == -1) {
+                next = static_cast<int>(_output.size());
+                _delta.resize(_delta.size() + _classCount, -1);
+                _output.push_back(ACTION_NONE);
+                _outputPattern.push_back(-1);
+            }
+            state = _delta[state * _classCount + c];
+        }
+        _output[state] |= _actions[p];
+        if (_outputPattern[state] == -1) {
+            _outputPattern[state] = static_cast<int>(p);
+        }
+    }
+
+    // Breadth-first pass: resolve failure links and fold them into the
+    // transition table so the scanner never has to follow them.
+    std::vector<int> fail(_output.size(), 0);
+    std::vector<int> queue;
+    queue.reserve(_output.size());
+    for (int c = 0; c < _classCount; ++c) {
+        int &next = _delta[c];
+        if (next == -1) {
+            next = 0;
+        } else {
+            fail[next] = 0;
+            queue.push_back(next);
+        }
+    }
+    for (std::size_t head = 0; head < queue.size(); ++head) {
+        int state = queue[head];
+        for (int c = 0; c < _classCount; ++c) {
+            int &next = _delta[state * _classCount + c];
+            int fallback = _delta[fail[state] * _classCount + c];
+            if (next == -1) {
+                next = fallback;
+                continue;
+            }
+            fail[next] = fallback;
+            _output[next] |= _output[fallback];
+            if (_outputPattern[next] == -1) {
+                _outputPattern[next] = _outputPattern[fallback];
+            }
+            queue.push_back(next);
+        }
+    }
+
+    for (int b = 0; b < 256; ++b) {
+        _startByte[b] = _classOf[b] != 0 && _delta[_classOf[b]] != 0;
+    }
+
+    // Case folding makes every letter two runs, so a few dozen patterns
+    // usually still fit the prefilter; thousands starting with any
+    // letter leave A-Z and a-z.
+    _rangeCount = 0;
+    for (int b = 0; b < 256; ++b) {
+        if (!_startByte[b] || (b > 0 && _startByte[b - 1])) {
+            continue;
+        }
+        int end = b;
+        while (end + 1 < 256 && _startByte[end + 1]) {
+            ++end;
+        }
+        if (_rangeCount == PREFILTER_RANGES) {
+            _rangeCount = 0;
+            break;
+        }
+        _rangeLow[_rangeCount] = static_cast<unsigned char>(b);
+        _rangeSpan[_rangeCount] = static_cast<unsigned char>(end - b);
+        ++_rangeCount;
+    }
+    return;
+}
+
+// Index of the first byte at or after i that can start a pattern, or len.
+// The first sixteen bytes go through the table: when start bytes are
+// common in the text (patterns starting with any letter, say) the next
+// one is usually that close, and setting up the vector loop would cost
+// more than it saves. A byte is in the run [low, low + span] when
+// byte - low, wrapping, is at most span.
+std::size_t SpamFilter::skipToStart(const unsigned char *data, std::size_t i, std::size_t len) const {
+    std::size_t tableEnd = std::min(len, i + 16);
+
+    while (i < tableEnd && !_startByte[data[i]]) {
+        ++i;
+    }
+    if (i < tableEnd || i == len) {
+        return i;
+    }
+#if defined(__SSE2__)
+    if (_rangeCount > 0) {
+        __m128i low[PREFILTER_RANGES];
+        __m128i span[PREFILTER_RANGES];
+        for (int r = 0; r < _rangeCount; ++r) {
+            low[r] = _mm_set1_epi8(static_cast<char>(_rangeLow[r]));
+            span[r] = _mm_set1_epi8(static_cast<char>(_rangeSpan[r]));
+        }
+        for (; i + 16 <= len; i += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            __m128i hit = _mm_setzero_si128();
+            for (int r = 0; r < _rangeCount; ++r) {
+                __m128i offset = _mm_sub_epi8(block, low[r]);
+                hit = _mm_or_si128(hit, _mm_cmpeq_epi8(_mm_min_epu8(offset, span[r]), offset));
+            }
+            int mask = _mm_movemask_epi8(hit);
+            if (mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    if (_rangeCount > 0) {
+        uint8x16_t low[PREFILTER_RANGES];
+        uint8x16_t span[PREFILTER_RANGES];
+        for (int r = 0; r < _rangeCount; ++r) {
+            low[r] = vdupq_n_u8(_rangeLow[r]);
+            span[r] = vdupq_n_u8(_rangeSpan[r]);
+        }
+        // a block with a hit is left to the table below to locate
+        for (; i + 16 <= len; i += 16) {
+            uint8x16_t block = vld1q_u8(data + i);
+            uint8x16_t hit = vdupq_n_u8(0);
+            for (int r = 0; r < _rangeCount; ++r) {
+                hit = vorrq_u8(hit, vcleq_u8(vsubq_u8(block, low[r]), span[r]));
+            }
+            if (vmaxvq_u8(hit) != 0) {
+                break;
+            }
+        }
+    }
+#endif
+    while (i < len && !_startByte[data[i]]) {
+        ++i;
+    }
+    return i;
+}
+
+int SpamFilter::scan(const std::string &text, std::string &matched) const {
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(text.data());
+    std::size_t len = text.size();
+    std::size_t i = 0;
+    int state = 0;
+    int actions = ACTION_NONE;
+
+    while (i < len) {
+        // Prefilter: from the root, skip straight to the next byte that
+        // can start a pattern instead of walking the table for each one.
+        if (state == 0) {
+            i = skipToStart(data, i, len);
+            if (i == len) {
+                break;
+            }
+        }
+        state = _delta[state * _classCount + _classOf[data[i++]]];
+        if (_output[state] != ACTION_NONE) {
+            if (matched.empty()) {
+                matched = _patterns[_outputPattern[state]];
+            }
+            actions |= _output[state];
+            if (actions & ACTION_BLOCK) {
+                break;
+            }
+        }
+    }
+    return actions;
+}
+
+void Server::reloadSpamFilter(void) {
+    SpamFilter *freshFilter = new SpamFilter();
+
+    if (!freshFilter->loadFromFile(SPAMFILTER_FILE)) {
+        delete freshFilter;
+        std::cout << "Spam filter: " << SPAMFILTER_FILE << " not found, keeping "
+                  << (_spamFilter ? _spamFilter->getPatternCount() : 0) << " patterns" << std::endl;
+        return;
+    }
+
+    // The new automaton is fully built before it replaces the old one, so
+    // no message is ever scanned against a partially loaded pattern set.
+    delete _spamFilter;
+    _spamFilter = freshFilter;
+    std::cout << "Spam filter loaded: " << _spamFilter->getPatternCount() << " patterns" << std::endl;
+    return;
+}
+
+bool Server::filterMessage(Client *client, const std::string &target, std::string &text) {
+    std::string matched;
+    int actions;
+
+    if (_spamFilter == NULL) {
+        return true;
+    }
+    actions = _spamFilter->scan(text, matched);
+    if (actions == SpamFilter::ACTION_NONE) {
+        return true;
+    }
+    if (actions & SpamFilter::ACTION_LOG) {
+        std::cout << "Spam filter: " << client->getNickname() << " -> " << target
+                  << " matched \"" << matched << "\"" << std::endl;
+    }
+    if (actions & SpamFilter::ACTION_BLOCK) {
+        return false;
+    }
+    if (actions & SpamFilter::ACTION_TAG) {
+        text = SPAMFILTER_TAG + text;
+    }
+    return true;
+}
@@ -0,0 +1,133 @@
+#include "../Includes/Utf8.hpp"
+#include <cstring>
+#include <stdint.h>
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+# include <arm_neon.h>
+#endif
+
+// Length of the ASCII run starting at data[0]. Sixteen bytes are tested at
+// a time with SSE2 or NEON where the target has them, then eight with a
+// word-wide high-bit test; a block with no high bit set is pure ASCII and
+// needs no decoding.
+static std::size_t asciiPrefix(const unsigned char *data, std::size_t len)
+{
+    const uint64_t highBits = 0x8080808080808080ULL;
+    std::size_t i = 0;
+    uint64_t word;
+
+#if defined(__SSE2__)
+    while (i + 16 <= len) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        if (_mm_movemask_epi8(block) != 0) {
+            break;
+        }
+        i += 16;
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    while (i + 16 <= len) {
+        if (vmaxvq_u8(vld1q_u8(data + i)) >= 0x80) {
+            break;
+        }
+        i += 16;
+    }
+#endif
+    while (i + sizeof(word) <= len) {
+        memcpy(&word, data + i, sizeof(word));
+        if (word & highBits) {
+            break;
+        }
+        i += sizeof(word);
+    }
+    while (i < len && data[i] < 0x80) {
+        ++i;
+    }
+    return i;
+}
+
+// Length of the well-formed multi-byte sequence at data[0], or 0 if it is
+// truncated, overlong, a surrogate or beyond U+10FFFF.
+static std::size_t sequenceLength(const unsigned char *data, std::size_t len)
+{
+    unsigned char lead = data[0];
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+    std::size_t size;
+
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        size = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        size = 3;
+        if (lead == 0xE0)
+            low = 0xA0;
+        else if (lead == 0xED)
+            high = 0x9F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        size = 4;
+        if (lead == 0xF0)
+            low = 0x90;
+        else if (lead == 0xF4)
+            high = 0x8F;
+    } else {
+        return 0;
+    }
+
+    if (len < size || data[1] < low || data[1] > high) {
+        return 0;
+    }
+    for (std::size_t i = 2; i < size; ++i) {
+        if ((data[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return size;
+}
+
+bool isValidUtf8(const std::string &text)
+{
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(text.data());
+    std::size_t len = text.size();
+    std::size_t i = 0;
+
+    while (i < len) {
+        i += asciiPrefix(data + i, len - i);
+        if (i == len) {
+            break;
+        }
+        std::size_t size = sequenceLength(data + i, len - i);
+        if (size == 0) {
+            return false;
+        }
+        i += size;
+    }
+    return true;
+}
+
+std::string sanitizeUtf8(const std::string &text)
+{
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(text.data());
+    std::size_t len = text.size();
+    std::size_t i = 0;
+    std::string result;
+
+    result.reserve(len);
+    while (i < len) {
+        std::size_t ascii = asciiPrefix(data + i, len - i);
+        result.append(text, i, ascii);
+        i += ascii;
+        if (i == len) {
+            break;
+        }
+        std::size_t size = sequenceLength(data + i, len - i);
+        if (size == 0) {
+            // One replacement character per invalid byte
+            result += UTF8_REPLACEMENT;
+            ++i;
+            continue;
+        }
+        result.append(text, i, size);
+        i += size;
+    }
+    return result;
+}
@@ -0,0 +1,224 @@
+#include "../Includes/Server.hpp"
+
+#ifdef IRC_ZEROCOPY
+# include <linux/errqueue.h>
+#endif
+
+ssize_t Server::sendOutput(Client *client) {
+    std::string &output = client->getOutBuffer();
+    ssize_t bytesSent;
+
+    if (output.empty()) {
+        return sendQueued(client);
+    }
+
+#ifdef IRC_ZEROCOPY
+    // Large flushes go out without a userspace-to-kernel copy. The buffer is
+    // pinned until the completion arrives on the socket's error queue.
+    if (output.size() >= ZEROCOPY_THRESHOLD && client->isZeroCopyEnabled()) {
+        bytesSent = send(client->getFd(), output.data(), output.size(), MSG_ZEROCOPY);
+        if (bytesSent > 0) {
+            client->pinOutput(bytesSent);
+            ++_zeroCopySends;
+            _zeroCopyBytes += bytesSent;
+            return bytesSent;
+        }
+        // ENOBUFS: the socket's optmem limit is used up by pinned pages
+        if (errno != ENOBUFS) {
+            return bytesSent;
+        }
+    }
+#endif
+
+    bytesSent = send(client->getFd(), output.data(), output.size(), 0);
+    if (bytesSent > 0) {
+        client->consumeOutput(bytesSent);
+        ++_copySends;
+        _copyBytes += bytesSent;
+    }
+    return bytesSent;
+}
+
+// Plain output goes out straight from the queued chunks and shared
+// broadcast buffers, up to OUTPUT_IOV_MAX of them per call
+ssize_t Server::sendQueued(Client *client) {
+    struct iovec iov[OUTPUT_IOV_MAX];
+    int count = client->serverReplies.fill(iov, OUTPUT_IOV_MAX);
+    ssize_t bytesSent;
+
+#ifdef IRC_ZEROCOPY
+    std::size_t total = 0;
+    for (int i = 0; i < count; ++i) {
+        total += iov[i].iov_len;
+    }
+    if (total >= ZEROCOPY_THRESHOLD && client->isZeroCopyEnabled()) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        bytesSent = sendmsg(client->getFd(), &msg, MSG_ZEROCOPY);
+        if (bytesSent > 0) {
+            client->pinQueued(bytesSent);
+            ++_zeroCopySends;
+            _zeroCopyBytes += bytesSent;
+            return bytesSent;
+        }
+        if (errno != ENOBUFS) {
+            return bytesSent;
+        }
+    }
+#endif
+
+    bytesSent = writev(client->getFd(), iov, count);
+    if (bytesSent > 0) {
+        client->serverReplies.consume(bytesSent);
+        ++_copySends;
+        _copyBytes += bytesSent;
+    }
+    return bytesSent;
+}
+
+#ifdef IRC_ZEROCOPY
+// Reads every completion queued on fd's error queue and hands the range of
+// sends it covers to release(first, last). Returns how many of them the
+// kernel had to copy anyway.
+template <class Release>
+static unsigned long reapCompletions(int fd, Release release)
+{
+    unsigned long copied = 0;
+
+    while (true) {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            break;
+        }
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR) {
+                continue;
+            }
+            struct sock_extended_err *err = reinterpret_cast<struct sock_extended_err *>(CMSG_DATA(cmsg));
+            if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                copied += err->ee_data - err->ee_info + 1;
+            }
+            release(err->ee_info, err->ee_data);
+        }
+    }
+    return copied;
+}
+#endif
+
+void Server::reapZeroCopyCompletions(int client_fd) {
+#ifdef IRC_ZEROCOPY
+    Client *client = _clients.find(client_fd);
+    if (client == NULL || client->getPinnedCount() == 0) {
+        return;
+    }
+
+    unsigned long copied = reapCompletions(client_fd, [client](unsigned int first, unsigned int last) {
+        client->releasePinned(first, last);
+    });
+    // The kernel had to copy anyway (e.g. loopback): stop paying for
+    // completion handling on this socket
+    if (copied > 0) {
+        _zeroCopyCopied += copied;
+        client->disableZeroCopy();
+    }
+#else
+    (void)client_fd;
+#endif
+}
+
+// Closes a client's socket, unless the kernel may still be reading pinned
+// zero-copy buffers from it: freeing those now could change bytes that
+// are yet to be sent. The socket is then shut down for writing, so the
+// peer still sees the close, and kept until drainZeroCopy() has seen
+// every completion.
+void Server::closeClientSocket(Client *client) {
+    int fd = client->getFd();
+
+#ifdef IRC_ZEROCOPY
+    if (client->getPinnedCount() > 0) {
+        _zeroCopyCopied += reapCompletions(fd, [client](unsigned int first, unsigned int last) {
+            client->releasePinned(first, last);
+        });
+    }
+    if (client->getPinnedCount() > 0) {
+        ZeroCopyDrain &drain = _zeroCopyDrains[fd];
+        drain.pinned = client->takePinned();
+        drain.deadline = ft_monotonicUsec() + ZEROCOPY_DRAIN_SECONDS * 1000000LL;
+        shutdown(fd, SHUT_WR);
+        _clients.setKind(fd, FD_DRAIN);
+        // the error queue raises POLLERR whatever the events asked for
+        pollfd *entry = findPollFd(fd);
+        if (entry != NULL) {
+            entry->events = 0;
+        }
+        return;
+    }
+#endif
+    close(fd);
+    releasePollFd(fd);
+}
+
+void Server::drainZeroCopy(pollfd &pfd) {
+#ifdef IRC_ZEROCOPY
+    // completions raise POLLERR; without it or a hangup there is nothing
+    // to reap, as for live clients in the run loop
+    if (!(pfd.revents & (POLLERR | POLLHUP))) {
+        return;
+    }
+    std::map<int, ZeroCopyDrain>::iterator found = _zeroCopyDrains.find(pfd.fd);
+    std::deque<PinnedOutput> *pinned = found->second.pinned;
+
+    if (pfd.revents & POLLERR) {
+        _zeroCopyCopied += reapCompletions(pfd.fd, [pinned](unsigned int first, unsigned int last) {
+            releasePinnedRange(*pinned, first, last);
+        });
+    }
+    // once the peer has gone too, nothing more will be sent from them
+    if (!pinned->empty() && !(pfd.revents & POLLHUP)) {
+        return;
+    }
+    releasePinnedRange(*pinned, 0, ~0u);
+    delete pinned;
+    _zeroCopyDrains.erase(found);
+    _clients.setKind(pfd.fd, FD_FREE);
+    close(pfd.fd);
+    releasePollFd(pfd.fd);
+#else
+    (void)pfd;
+#endif
+}
+
+// A peer that stops acknowledging would hold its buffers forever. Past the
+// deadline the connection is reset: an abortive close purges the send
+// queue, so the kernel sends nothing more from those pages.
+void Server::expireZeroCopyDrains(long long now) {
+    std::map<int, ZeroCopyDrain>::iterator it = _zeroCopyDrains.begin();
+
+    while (it != _zeroCopyDrains.end()) {
+        if (it->second.deadline > now) {
+            ++it;
+            continue;
+        }
+        struct linger reset;
+        reset.l_onoff = 1;
+        reset.l_linger = 0;
+        setsockopt(it->first, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+        _clients.setKind(it->first, FD_FREE);
+        close(it->first);
+        releasePollFd(it->first);
+        releasePinnedRange(*it->second.pinned, 0, ~0u);
+        delete it->second.pinned;
+        _zeroCopyDrains.erase(it++);
+    }
+}
@@ -2,7 +2,7 @@
 
 void Server::handleInviteCommand(Client *client, const ParseMessage &ParsedMsg)
 {
-    std::vector<std::string> params = ParsedMsg.getParams();
+    const ScratchVector<std::string> &params = ParsedMsg.getParams();
     std::string response = "";
 	std::string targetNickname;
 	 std::string channelName;
@@ -2,10 +2,10 @@
 
 void Server::joinCommand(Client *client, const ParseMessage &ParsedMsg)
 {
-    std::vector<std::string> params = ParsedMsg.getParams();
-    std::vector<std::string> key_list;
-    std::vector<std::string>::iterator itr_key;
-    std::vector<std::string>::iterator itr_chan;
+    const ScratchVector<std::string> &params = ParsedMsg.getParams();
+    ScratchVector<std::string> key_list;
+    ScratchVector<std::string>::iterator itr_key;
+    ScratchVector<std::string>::iterator itr_chan;
     std::string response = "";
     bool allowedJoin = true;
 
@@ -16,7 +16,7 @@ void Server::joinCommand(Client *client, const ParseMessage &ParsedMsg)
         return;
     }
 
-    std::vector<std::string> chan_list = ft_split(params[0], ',');
+    ScratchVector<std::string> chan_list = ft_split(params[0], ',');
     if(params.size() > 1)
     {
         key_list = ft_split(params[1], ',');
@@ -70,7 +70,8 @@ void Server::joinCommand(Client *client, const ParseMessage &ParsedMsg)
             {
                 response = RPL_JOIN(user_id(client->getNickname(), client->getUsername()), chanName);
                 tempChannel.removeInvite(client->getNickname());
-                tempChannel.broadcastMessage(response);
+                if (!shouldShed(tempChannel))
+                    tempChannel.broadcastMessage(response);
                 tempChannel.addClient(client);
                 response = greetJoinedUser(*client, tempChannel);
             }
@@ -79,10 +80,7 @@ void Server::joinCommand(Client *client, const ParseMessage &ParsedMsg)
         }
         else
         {
-            response = RPL_JOIN(user_id(client->getNickname(), client->getUsername()), chanName);
-            _channels.insert(make_pair(chanName, Channel(chanName, client)));
-            response = greetJoinedUser(*client, getChannel(chanName));
-            client->serverReplies.push_back(response);
+            client->serverReplies.push_back(greetJoinedUser(*client, _channels.create(chanName, client)));
         }
     }
 }
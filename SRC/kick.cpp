@@ -3,7 +3,7 @@
 
 void Server::handelKickCommand(Client *client, const ParseMessage &ParsedMsg)
 {
-    std::vector<std::string> params = ParsedMsg.getParams();
+    const ScratchVector<std::string> &params = ParsedMsg.getParams();
 
     if (params.size() < 2) {
         client->serverReplies.push_back(ERR_NEEDMOREPARAMS(client->getNickname(), "KICK"));
@@ -29,8 +29,8 @@ void Server::handelKickCommand(Client *client, const ParseMessage &ParsedMsg)
         return;
     }
 
-    std::vector<std::string> users = ft_split(params[1], ',');
-    for (std::vector<std::string>::iterator it = users.begin(); it != users.end(); ++it)
+    ScratchVector<std::string> users = ft_split(params[1], ',');
+    for (ScratchVector<std::string>::iterator it = users.begin(); it != users.end(); ++it)
     {
         std::string targetNick = *it;
         
@@ -52,8 +52,8 @@ void Server::handelKickCommand(Client *client, const ParseMessage &ParsedMsg)
         channel.broadcastMessage(kickMsg);
         channel.removeClient(targetClient);
 
-        if (channel.getUsers().empty()) {
-            _channels.erase(channelName);
+        if (reapChannel(channel)) {
+            return;
         }
     }
 }
\ No newline at end of file
@@ -1,7 +1,7 @@
 #include "../Includes/Server.hpp"
 
 bool Server::handleKeyMode(Client *client, Channel &channel, bool isAdding,
-      std::vector<std::string> &params, std::size_t &paramIndex)
+      ScratchVector<std::string> &params, std::size_t &paramIndex)
 {
     std::map<char, bool> modesMap = channel.getModesMap();
     std::map<char, bool>::iterator itr = modesMap.find('k');
@@ -38,7 +38,7 @@ bool Server::handleKeyMode(Client *client, Channel &channel, bool isAdding,
 }
 
 bool Server::handleLimitMode(Client *client, Channel &channel, bool isAdding,
-      std::vector<std::string> &params, std::size_t &paramIndex)
+      ScratchVector<std::string> &params, std::size_t &paramIndex)
 {
     int UserLimit;
     std::map<char, bool> modesMap = channel.getModesMap();
@@ -77,7 +77,7 @@ bool Server::handleLimitMode(Client *client, Channel &channel, bool isAdding,
 }
 
 bool Server::handleOperatorMode(Client *client, Channel &channel, bool isAdding,
-      std::vector<std::string> &params, std::size_t &paramIndex)
+      ScratchVector<std::string> &params, std::size_t &paramIndex)
 {
     std::map<char, bool> modesMap = channel.getModesMap();
     std::map<char, bool>::iterator itr = modesMap.find('o');
@@ -109,7 +109,7 @@ bool Server::handleOperatorMode(Client *client, Channel &channel, bool isAdding,
 }
 
 bool Server::processSingleChannelMode(Client *client, Channel &channel,
-    char mode, bool isAdding, std::vector<std::string> &params,
+    char mode, bool isAdding, ScratchVector<std::string> &params,
     std::size_t &paramIndex)
 {
     switch (mode)
@@ -135,7 +135,7 @@ bool Server::processSingleChannelMode(Client *client, Channel &channel,
 }
 
 void Server::processChannelModes(Client *client, Channel &channel,
-      std::vector<std::string> &params)
+      ScratchVector<std::string> &params)
 {
     bool	isAdding;
     std::size_t	paramIndex;
@@ -167,7 +167,7 @@ void Server::processChannelModes(Client *client, Channel &channel,
 }
 
 void Server::handleChannelMode(Client *client, std::string &channelName,
-      std::vector<std::string> &params)
+      ScratchVector<std::string> &params)
 {
     if (!Server::isChannelInServer(channelName))
     {
@@ -184,7 +184,7 @@ void Server::handleChannelMode(Client *client, std::string &channelName,
     }
     else
     {
-        if (!channel.isOperator(const_cast<std::string &>(client->getNickname())))
+        if (!channel.isOperator(nick))
         {
             client->serverReplies.push_back(ERR_CHANOPRIVSNEEDED(client->getNickname(),
                     channelName));
@@ -196,11 +196,11 @@ void Server::handleChannelMode(Client *client, std::string &channelName,
 
 void Server::handelModeCommand(Client *client, const ParseMessage &parsedMsg)
 {
-    std::vector<std::string> params = parsedMsg.getParams();
+    ScratchVector<std::string> params = parsedMsg.getParams();
 
     if(parsedMsg.getTrailing().empty() == false)
     {
-        std::vector<std::string> splitTrailing = ft_split(parsedMsg.getTrailing(), ' ');
+        ScratchVector<std::string> splitTrailing = ft_split(parsedMsg.getTrailing(), ' ');
         params.insert(params.end(), splitTrailing.begin(), splitTrailing.end());
     }
 
@@ -1,32 +1,47 @@
 #include "../Includes/Server.hpp"
 
-void	Server::motdCommand(Client *client)
+void	Server::loadWelcomeTemplate(void)
 {
-    std::ostringstream oss;
+    std::string nick(TEMPLATE_NICK);
+    std::string user(TEMPLATE_USER);
+    std::string burst;
     std::string line;
     std::ifstream infile;
 
-	if(!client->isRegistered)
-		return;
     infile.open("./MOTD.txt", std::ios::in);
-	
-	client->serverReplies.push_back( RPL_WELCOME(user_id(client->getNickname(),client->getUsername()),client->getNickname()));
-	client->serverReplies.push_back( RPL_YOURHOST(client->getUsername(),"irssi", "1"));
-	client->serverReplies.push_back( RPL_CREATED(client->getUsername(), std::string("creation_date")));
-	client->serverReplies.push_back( RPL_MYINFO(client->getUsername(),"irssi", "1", "","",""));
-	client->serverReplies.push_back( RPL_ISUPPORT(client->getUsername(),"CHANMODES=ikolt"));
-	client->serverReplies.push_back( RPL_MOTDSTART(client->getUsername(),std::string("ircserver")));
+
+	burst += RPL_WELCOME(user_id(nick, user), nick);
+	burst += RPL_YOURHOST(user, "irssi", "1");
+	burst += RPL_CREATED(user, std::string("creation_date"));
+	burst += RPL_MYINFO(user, "irssi", "1", "", "", "");
+	if (UTF8_ONLY)
+		burst += RPL_ISUPPORT(user, "CHANMODES=ikolt UTF8ONLY");
+	else
+		burst += RPL_ISUPPORT(user, "CHANMODES=ikolt");
+	burst += RPL_MOTDSTART(user, std::string("ircserver"));
     if (infile.is_open())
     {
         while (std::getline(infile,line))
         {
-            client->serverReplies.push_back( RPL_MOTD(std::string("ircserver"),line));
+            burst += RPL_MOTD(std::string("ircserver"), line);
         }
         infile.close();
     }
     else
-        client->serverReplies.push_back( ERR_NOMOTD(std::string("ircserver")));
-		
-    client->serverReplies.push_back( RPL_ENDOFMOTD(std::string("ircserver")));
+        burst += ERR_NOMOTD(std::string("ircserver"));
+    burst += RPL_ENDOFMOTD(std::string("ircserver"));
+
+    _welcomeTemplate.compile(burst);
+    return ;
+}
+
+void	Server::motdCommand(Client *client)
+{
+	if(!client->isFullyRegistered())
+		return;
+	if (_welcomeTemplate.empty())
+		loadWelcomeTemplate();
+
+	client->serverReplies.push_back(_welcomeTemplate.render(client->getNickname(), client->getUsername()));
     return ;
 }
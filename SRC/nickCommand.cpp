@@ -2,7 +2,7 @@
 
 
 
-void 	Server::nickCommand(Client *client, const std::vector<std::string> &params)
+void 	Server::nickCommand(Client *client, const ScratchVector<std::string> &params)
 {
 	if(params.size() < 1)
 	{
@@ -10,35 +10,40 @@ void 	Server::nickCommand(Client *client, const std::vector<std::string> &params
 		return ;
 	}
 	std::string newNick = params[0]; //also new nick could be getTrailing()
-    if (newNick.find_first_of("#@:&") != std::string::npos)
+    // Nicknames live in a fixed buffer inside Client, so longer ones are refused
+    if (newNick.size() > NICKLEN || newNick.find_first_of("#@:&") != std::string::npos)
     {
        client->serverReplies.push_back(ERR_ERRONEUSNICKNAME(std::string("ircserver"), newNick));
 	   return ;
     }
-    else if (_nicknames.empty() == false && std::find(_nicknames.begin(), _nicknames.end(), newNick) != _nicknames.end())
+	// The folded lookup also finds the client's own nick: a change of case
+	// only (bob -> Bob) is allowed, keeps the same key and updates the
+	// display form below
+	Client *holder = getClient(newNick);
+	if (holder == client && newNick == client->getNickname())
+		return ;
+    else if (holder != NULL && holder != client)
     {
        client->serverReplies.push_back(ERR_NICKNAMEINUSE(std::string("ircserver"), newNick));
 	   return ;
     } 
     else if (client->getNickname().empty() == false)
     {
-        _nicknames.erase(std::remove(_nicknames.begin(), _nicknames.end(),client->getNickname()), _nicknames.end());
+        _nicknames.erase(ChannelTable::fold(client->getNickname()));
        client->serverReplies.push_back(RPL_NICK(client->getNickname(),client->getUsername(), newNick));
     }
-	_nicknames.push_back(newNick);
-	//add function update nicknames in channels
-	// Check all channels in server where that client is joined currently
-	for (std::map<std::string, Channel>::iterator it = _channels.begin(); it != _channels.end(); ++it)
+	_nicknames[ChannelTable::fold(newNick)] = client;
+	// Only the channels this client is in or invited to know its nick
+	const std::set<std::string> *channelSets[] = { &client->getMemberships(), &client->getInvites() };
+	for (std::size_t i = 0; i < 2; ++i)
 	{
-		if (it->second.isClientInChannel(client->getNickname()))
-		{	
-			it->second.updateNickname(client->getNickname(), newNick);
-		} else if (it->second.isInvited(client->getNickname()))
+		for (std::set<std::string>::const_iterator it = channelSets[i]->begin(); it != channelSets[i]->end(); ++it)
 		{
-			it->second.updateNickname(client->getNickname(), newNick);
+			Channel *chan = _channels.find(*it);
+			if (chan != NULL)
+				chan->updateNickname(client->getNickname(), newNick);
 		}
 	}
-	// If client is in channel, update the nickname in that channel
 
 	client->setNickname(newNick);
 }
\ No newline at end of file
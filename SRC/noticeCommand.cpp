@@ -2,13 +2,15 @@
 
 void Server::noticeCommand(Client *client, const ParseMessage &parsedMsg)
 {
-    const std::vector<std::string>& params = parsedMsg.getParams();
-    const std::string& trailing = parsedMsg.getTrailing().empty() ? "" : parsedMsg.getTrailing();
+    const ScratchVector<std::string>& params = parsedMsg.getParams();
+    std::string trailing = parsedMsg.getTrailing().empty() ? "" : parsedMsg.getTrailing();
 
     if (params.empty() || trailing.empty()) { return; }
+    // NOTICE never generates replies, so blocked text is dropped silently
+    if (!filterMessage(client, params[0], trailing)) { return; }
 
-    std::vector<std::string> receivers = ft_split(params[0], ',');
-    std::vector<std::string>::const_iterator it;
+    ScratchVector<std::string> receivers = ft_split(params[0], ',');
+    ScratchVector<std::string>::const_iterator it;
 
     for (it = receivers.begin(); it != receivers.end(); ++it)
     {
@@ -30,11 +32,12 @@ void Server::noticeCommand(Client *client, const ParseMessage &parsedMsg)
         }
         else
         {
-            if (!isUserInServer(receiver))
+            Client *recipient = getClient(receiver);
+            if (recipient == NULL)
             {
                 continue;
             }
-            getClient(receiver)->serverReplies.push_back(RPL_NOTICE(client->getNickname(), client->getUsername(), receiver, trailing));
+            recipient->serverReplies.push_back(RPL_NOTICE(client->getNickname(), client->getUsername(), receiver, trailing));
         }
     }
 }
\ No newline at end of file
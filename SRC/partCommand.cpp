@@ -2,7 +2,7 @@
 
 void Server::partCommand(Client *client, const ParseMessage &ParsedMsg)
 {
-    std::vector<std::string> params = ParsedMsg.getParams();
+    const ScratchVector<std::string> &params = ParsedMsg.getParams();
     std::string response = "";
 
     if (params.empty()) {
@@ -10,10 +10,10 @@ void Server::partCommand(Client *client, const ParseMessage &ParsedMsg)
         return;
     }
 
-    std::vector<std::string> chan_list = ft_split(params[0], ',');
+    ScratchVector<std::string> chan_list = ft_split(params[0], ',');
     std::string reason = ParsedMsg.getTrailing().size() ? ParsedMsg.getTrailing() : "";
 
-    for (std::vector<std::string>::iterator itr_chan = chan_list.begin(); itr_chan != chan_list.end(); ++itr_chan)
+    for (ScratchVector<std::string>::iterator itr_chan = chan_list.begin(); itr_chan != chan_list.end(); ++itr_chan)
     {
         std::string chanName = *itr_chan;
         if (chanName[0] != '#' && chanName[0] != '&')
@@ -29,12 +29,10 @@ void Server::partCommand(Client *client, const ParseMessage &ParsedMsg)
             }
             else {
                 std::string partMsg = RPL_PART(user_id(client->getNickname(), client->getUsername()), tempChannel.getChannelName(), reason);
-                tempChannel.broadcastMessage(partMsg);
+                if (!shouldShed(tempChannel))
+                    tempChannel.broadcastMessage(partMsg);
                 tempChannel.removeClient(client);
-                if (tempChannel.getUsers().empty())
-				{
-                    _channels.erase(chanName);
-                }
+                reapChannel(tempChannel);
                 client->serverReplies.push_back(partMsg);
                 continue;
             }
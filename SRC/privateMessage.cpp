@@ -5,8 +5,8 @@
 
 void Server::privateMessage(Client *client, const ParseMessage &parsedMsg)
 {
-    const std::vector<std::string>& params = parsedMsg.getParams();
-    const std::string& trailing = parsedMsg.getTrailing();
+    const ScratchVector<std::string>& params = parsedMsg.getParams();
+    std::string trailing = parsedMsg.getTrailing();
 	std::string receiver; 
 
     // Validate required parameters
@@ -24,6 +24,16 @@ void Server::privateMessage(Client *client, const ParseMessage &parsedMsg)
 		receiver = params[0];
 	}
 
+	// Drop the message if it matches a blocking spam filter pattern
+	if (!filterMessage(client, receiver, trailing))
+	{
+		if (receiver[0] == '#' || receiver[0] == '&')
+			client->serverReplies.push_back(ERR_CANNOTSENDTOCHAN(client->getNickname(), receiver));
+		else
+			client->serverReplies.push_back(ERR_CANNOTSENDTOUSER(client->getNickname(), receiver));
+		return;
+	}
+
     // Handle channel messages
     if(receiver[0] == '#' || receiver[0] == '&') //potential segfault here for receiver
     {
@@ -49,13 +59,13 @@ void Server::privateMessage(Client *client, const ParseMessage &parsedMsg)
     else
     {
         // Validate target user exists
-        if (!isUserInServer(receiver))
+        Client *recipientClient = getClient(receiver);
+        if (recipientClient == NULL)
         {
             client->serverReplies.push_back(ERR_NOSUCHNICK(client->getNickname(), receiver));
             return;
         }
         // Send private message to recipient
-        Client *recipientClient = getClient(receiver);
         recipientClient->serverReplies.push_back(RPL_PRIVMSG(client->getNickname(), client->getUsername(), receiver, trailing));
     }
 }
\ No newline at end of file
@@ -3,27 +3,103 @@
 #include <sstream>
 #include "../Includes/Channel.hpp"
 
-void	Server::quitCommand(std::string reason, Client *client) //there are some changes to take care of 
+CommandResult	Server::quitCommand(const std::string &reason, Client *client)
 {
-	std::map<std::string, Channel>::iterator	itr;
+	scheduleClose(client, reason.empty() ? "has quit" : reason, false);
+	return COMMAND_CLOSE;
+}
+
+void	Server::scheduleClose(Client *client, const std::string &reason, bool detach)
+{
+	PendingClose pending;
+
+	if (client->isClosing())
+		return;
+	client->setClosing();
+	pending.client = client->getHandle();
+	pending.reason = reason;
+	pending.detach = detach;
+	_pendingCloses.push_back(pending);
+}
+
+// Runs once the loop iteration is over, when nothing further up the
+// stack can still hold one of these clients
+void	Server::processPendingCloses(void)
+{
+	std::vector<PendingClose> closes;
+
+	closes.swap(_pendingCloses);
+	for (std::vector<PendingClose>::iterator it = closes.begin(); it != closes.end(); ++it)
+	{
+		// the handle is all a pending close holds on to
+		Client *client = resolveClient(it->client);
+		if (client == NULL)
+			continue;
+		if (!it->detach || !detachSession(client))
+			teardownClient(client, it->reason);
+	}
+}
+
+// poll() skips the entry until compactPollFds() removes it
+void	Server::releasePollFd(int fd)
+{
+	pollfd	*entry = findPollFd(fd);
+
+	if (entry == NULL)
+		return;
+	_releasedSlots.push_back(_pollSlots[fd]);
+	_pollSlots[fd] = -1;
+	entry->fd = -1;
+}
+
+// The one way a client leaves the server, whether by QUIT, a dropped
+// socket, an error, an expired session or an admin kill. It walks only
+// the channels the client is in or invited to, then frees the Client.
+void	Server::teardownClient(Client *client, const std::string &reason)
+{
+	int clientFd = client->getFd();
 	std::string nickname = client->getNickname();
-	std::string message = "has quit";
+	std::string quitMsg = RPL_QUIT(user_id(nickname, client->getUsername()), reason);
+
+	// copies: removeClient() and removeInvite() edit the client's sets
+	std::set<std::string> memberships = client->getMemberships();
+	for (std::set<std::string>::iterator it = memberships.begin(); it != memberships.end(); ++it)
+	{
+		Channel *chan = _channels.find(*it);
+		if (chan == NULL)
+			continue;
+		if (!shouldShed(*chan))
+			chan->sendToOthers(client, quitMsg);
+		chan->removeClient(client);
+		reapChannel(*chan);
+	}
+	std::set<std::string> invites = client->getInvites();
+	for (std::set<std::string>::iterator it = invites.begin(); it != invites.end(); ++it)
+	{
+		Channel *chan = _channels.find(*it);
+		if (chan != NULL)
+			chan->removeInvite(nickname);
+	}
+	if (!nickname.empty())
+		_nicknames.erase(ChannelTable::fold(nickname));
 
-	for (itr = _channels.begin(); itr != _channels.end(); itr++) //the channels in the server
+	if (clientFd != -1)
 	{
-		if(itr->second.isClientInChannel(nickname)) //if in channel
-		{
-			if(reason.empty())
-			{
-				itr->second.broadcastMessage(RPL_QUIT(user_id(client->getNickname(), client->getUsername()), message));
-			}
-			else
-			{
-				itr->second.broadcastMessage(RPL_QUIT(user_id(client->getNickname(), client->getUsername()), reason));
-			}
-			itr->second.removeClient(client);
-		}
+		cancelClientTasks(clientFd);
+		_deferredRegistrations.erase(clientFd);
+		_clients.erase(clientFd);
+		closeClientSocket(client);
 	}
-	client->setFd(-1);
-	throw(std::exception());
-}
\ No newline at end of file
+	std::cout << "Client " << clientFd << " (" << nickname << ") closed: " << reason << std::endl;
+	delete client;
+}
+
+// Every departure path (PART, KICK, QUIT, teardown) ends here
+bool	Server::reapChannel(Channel &channel)
+{
+	if (!channel.getUsers().empty())
+		return false;
+	channel.releaseInvites();
+	_channels.erase(channel);
+	return true;
+}
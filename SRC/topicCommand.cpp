@@ -4,7 +4,7 @@
 
 void Server::topicCommand(Client *client, const ParseMessage &ParsedMsg)
 {
-    std::vector<std::string> params = ParsedMsg.getParams();
+    const ScratchVector<std::string> &params = ParsedMsg.getParams();
     std::string response = "";
     std::string channelName;
     std::string newTopic;
@@ -0,0 +1,920 @@
+// Load generator for ircserv. Drives many client connections from one
+// poll() loop and prints one JSON object per run on stdout.
+//
+//   bench/loadgen <scenario> [key=value ...]
+//
+// Common keys: host, port, pass, pid (the server's pid, to report its CPU
+// time from /proc), timeout (seconds), sources (spread connections over
+// 127.0.0.1 to 127.0.0.<sources>, past one address's ephemeral ports),
+// busy=1 (poll without sleeping: waking from poll() costs this generator
+// a millisecond or more, which would otherwise show up in latencies).
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef std::map<std::string, std::string> Options;
+
+struct Connection {
+    int         fd;
+    std::string nick;
+    std::string input;
+    std::string output;
+    long long   connectedAt;
+    long long   welcomedAt;
+    bool        closed;
+    // scenario counters
+    long        received;
+    long        pongs;
+    long long   lastPongAt;
+};
+
+static long long monotonicUsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<long long>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static std::string option(const Options &options, const std::string &key, const std::string &fallback)
+{
+    Options::const_iterator it = options.find(key);
+
+    return it == options.end() ? fallback : it->second;
+}
+
+static long optionLong(const Options &options, const std::string &key, long fallback)
+{
+    Options::const_iterator it = options.find(key);
+
+    return it == options.end() ? fallback : std::atol(it->second.c_str());
+}
+
+// utime + stime of a process in microseconds, -1 when it can't be read
+static long long processCpuUsec(long pid)
+{
+    std::ostringstream path;
+    path << "/proc/" << pid << "/stat";
+    std::ifstream stat(path.str().c_str());
+    std::string line;
+
+    if (pid <= 0 || !std::getline(stat, line)) {
+        return -1;
+    }
+    // the command name may hold spaces; fields are counted after it
+    std::istringstream fields(line.substr(line.rfind(')') + 2));
+    std::string field;
+    long long utime = 0;
+    long long stime = 0;
+    for (int i = 3; i <= 15 && fields >> field; ++i) {
+        if (i == 14) {
+            utime = std::atoll(field.c_str());
+        } else if (i == 15) {
+            stime = std::atoll(field.c_str());
+        }
+    }
+    return (utime + stime) * 1000000 / sysconf(_SC_CLK_TCK);
+}
+
+// Resident set of a process in bytes, -1 when it can't be read
+static long long processRssBytes(long pid)
+{
+    std::ostringstream path;
+    path << "/proc/" << pid << "/statm";
+    std::ifstream statm(path.str().c_str());
+    long long pages = 0;
+    long long resident = 0;
+
+    if (pid <= 0 || !(statm >> pages >> resident)) {
+        return -1;
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+class Driver {
+
+    public:
+
+        std::vector<Connection> conns;
+
+        explicit Driver(const Options &options)
+            : _host(option(options, "host", "127.0.0.1")),
+              _port(static_cast<int>(optionLong(options, "port", 6667))),
+              _pass(option(options, "pass", "pw")),
+              _timeoutUsec(optionLong(options, "timeout", 60) * 1000000LL),
+              _sources(std::max(1L, optionLong(options, "sources", 1))),
+              _pollTimeout(optionLong(options, "busy", 0) ? 0 : 100) {
+        }
+
+        ~Driver(void) {
+            for (std::size_t i = 0; i < conns.size(); ++i) {
+                close(i);
+            }
+        }
+
+        // Opens a connection and queues its registration; returns its index
+        std::size_t open(const std::string &nick) {
+            Connection conn;
+            sockaddr_in address;
+
+            memset(&address, 0, sizeof(address));
+            address.sin_family = AF_INET;
+            address.sin_port = htons(_port);
+            inet_pton(AF_INET, _host.c_str(), &address.sin_addr);
+
+            conn.fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (conn.fd != -1 && _sources > 1) {
+                sockaddr_in source;
+
+                memset(&source, 0, sizeof(source));
+                source.sin_family = AF_INET;
+                source.sin_addr.s_addr = htonl(INADDR_LOOPBACK + conns.size() % _sources);
+                if (bind(conn.fd, (sockaddr *)&source, sizeof(source)) == -1) {
+                    perror("bind");
+                    std::exit(1);
+                }
+            }
+            if (conn.fd == -1 || connect(conn.fd, (sockaddr *)&address, sizeof(address)) == -1) {
+                perror("connect");
+                std::exit(1);
+            }
+            int one = 1;
+            setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            fcntl(conn.fd, F_SETFL, O_NONBLOCK);
+            conn.nick = nick;
+            conn.output = "CAP LS\r\nPASS " + _pass + "\r\nNICK " + nick + "\r\nUSER " + nick + " 0 * :" + nick + "\r\nCAP END\r\n";
+            conn.connectedAt = monotonicUsec();
+            conn.welcomedAt = 0;
+            conn.closed = false;
+            conn.received = 0;
+            conn.pongs = 0;
+            conn.lastPongAt = 0;
+            conns.push_back(conn);
+            return conns.size() - 1;
+        }
+
+        void send(std::size_t index, const std::string &line) {
+            conns[index].output += line;
+            conns[index].output += "\r\n";
+        }
+
+        void close(std::size_t index) {
+            if (!conns[index].closed) {
+                ::close(conns[index].fd);
+                conns[index].closed = true;
+            }
+        }
+
+        // Drops the connection with a RST instead of a FIN
+        void reset(std::size_t index) {
+            struct linger abort = { 1, 0 };
+
+            setsockopt(conns[index].fd, SOL_SOCKET, SO_LINGER, &abort, sizeof(abort));
+            close(index);
+        }
+
+        // Polls until done() holds or the timeout expires; false on timeout
+        template <class Done>
+        bool run(Done done) {
+            long long deadline = monotonicUsec() + _timeoutUsec;
+            std::vector<pollfd> fds;
+            std::vector<std::size_t> owners;
+
+            while (!done()) {
+                if (monotonicUsec() > deadline) {
+                    return false;
+                }
+                fds.clear();
+                owners.clear();
+                for (std::size_t i = 0; i < conns.size(); ++i) {
+                    if (conns[i].closed) {
+                        continue;
+                    }
+                    pollfd entry;
+                    entry.fd = conns[i].fd;
+                    entry.events = POLLIN | (conns[i].output.empty() ? 0 : POLLOUT);
+                    entry.revents = 0;
+                    fds.push_back(entry);
+                    owners.push_back(i);
+                }
+                if (fds.empty()) {
+                    return done();
+                }
+                if (poll(&fds[0], fds.size(), _pollTimeout) <= 0) {
+                    // spinning, but the server comes first on a shared CPU
+                    if (_pollTimeout == 0) {
+                        sched_yield();
+                    }
+                    continue;
+                }
+                for (std::size_t i = 0; i < fds.size(); ++i) {
+                    if (fds[i].revents & POLLOUT) {
+                        flush(owners[i]);
+                    }
+                    if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                        receive(owners[i]);
+                    }
+                }
+            }
+            return true;
+        }
+
+        std::size_t welcomed(void) const {
+            std::size_t count = 0;
+
+            for (std::size_t i = 0; i < conns.size(); ++i) {
+                count += conns[i].welcomedAt != 0;
+            }
+            return count;
+        }
+
+        std::size_t closedByServer(void) const { return _closedByServer; }
+
+    private:
+
+        std::string _host;
+        int         _port;
+        std::string _pass;
+        long long   _timeoutUsec;
+        long        _sources;
+        int         _pollTimeout;
+        std::size_t _closedByServer = 0;
+
+        void flush(std::size_t index) {
+            Connection &conn = conns[index];
+            ssize_t sent = ::send(conn.fd, conn.output.data(), conn.output.size(), MSG_NOSIGNAL);
+
+            if (sent > 0) {
+                conn.output.erase(0, sent);
+            }
+        }
+
+        void receive(std::size_t index) {
+            Connection &conn = conns[index];
+            char chunk[65536];
+            ssize_t got = recv(conn.fd, chunk, sizeof(chunk), 0);
+
+            if (got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                close(index);
+                ++_closedByServer;
+                return;
+            }
+            if (got < 0) {
+                return;
+            }
+            conn.input.append(chunk, got);
+            std::size_t start = 0;
+            std::size_t end;
+            while ((end = conn.input.find('\n', start)) != std::string::npos) {
+                line(conn, conn.input.substr(start, end - start));
+                start = end + 1;
+            }
+            conn.input.erase(0, start);
+        }
+
+        void line(Connection &conn, const std::string &text) {
+            ++conn.received;
+            if (text.compare(0, 5, "PING ") == 0) {
+                conn.output += "PONG " + text.substr(5) + "\n";
+            } else if (text.find(" PONG ") != std::string::npos) {
+                ++conn.pongs;
+                conn.lastPongAt = monotonicUsec();
+            } else if (conn.welcomedAt == 0 && text.find(" 001 ") != std::string::npos) {
+                conn.welcomedAt = monotonicUsec();
+            }
+        }
+};
+
+static std::string nickFor(const std::string &prefix, std::size_t i)
+{
+    std::ostringstream nick;
+
+    nick << prefix << i;
+    return nick.str();
+}
+
+// Connects and registers count clients; false if some were not welcomed
+static bool registerAll(Driver &driver, std::size_t count, const std::string &prefix)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        driver.open(nickFor(prefix, i));
+    }
+    return driver.run([&] { return driver.welcomed() == count; });
+}
+
+// Sends a PING from every connection and waits for each PONG, so
+// everything sent before it has been processed by the server
+static bool barrier(Driver &driver)
+{
+    std::vector<long> expected(driver.conns.size());
+
+    for (std::size_t i = 0; i < driver.conns.size(); ++i) {
+        expected[i] = driver.conns[i].pongs + 1;
+        driver.send(i, "PING barrier");
+    }
+    return driver.run([&] {
+        for (std::size_t i = 0; i < driver.conns.size(); ++i) {
+            if (!driver.conns[i].closed && driver.conns[i].pongs < expected[i]) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+// Connect-to-001 times of conns[first, last) in microseconds, sorted;
+// clients never welcomed are left out
+static std::vector<long long> welcomeTimes(const Driver &driver, std::size_t first, std::size_t last)
+{
+    std::vector<long long> times;
+
+    for (std::size_t i = first; i < last; ++i) {
+        if (driver.conns[i].welcomedAt != 0) {
+            times.push_back(driver.conns[i].welcomedAt - driver.conns[i].connectedAt);
+        }
+    }
+    std::sort(times.begin(), times.end());
+    return times;
+}
+
+static long long percentile(const std::vector<long long> &sorted, int percent)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[(sorted.size() - 1) * percent / 100];
+}
+
+static void printPercentiles(const char *key, const std::vector<long long> &sorted)
+{
+    std::cout << ",\"" << key << "\":{\"p50\":" << percentile(sorted, 50)
+              << ",\"p90\":" << percentile(sorted, 90)
+              << ",\"p99\":" << percentile(sorted, 99)
+              << ",\"max\":" << percentile(sorted, 100) << "}";
+}
+
+// Same, with p99.9 for runs that take thousands of samples
+static void printTailPercentiles(const char *key, const std::vector<long long> &sorted)
+{
+    long long p999 = sorted.empty() ? 0 : sorted[(sorted.size() - 1) * 999 / 1000];
+
+    std::cout << ",\"" << key << "\":{\"samples\":" << sorted.size()
+              << ",\"p50\":" << percentile(sorted, 50)
+              << ",\"p99\":" << percentile(sorted, 99)
+              << ",\"p999\":" << p999
+              << ",\"max\":" << percentile(sorted, 100) << "}";
+}
+
+// register: clients=N batch=B registers N clients, B at a time, each
+// batch once the previous one is welcomed. Reports connect-to-001
+// percentiles and registrations per second.
+static int registerScenario(const Options &options)
+{
+    Driver driver(options);
+    std::size_t clients = optionLong(options, "clients", 1000);
+    std::size_t batch = std::max(1L, optionLong(options, "batch", 50));
+    long pid = optionLong(options, "pid", 0);
+    bool complete = true;
+
+    long long cpuBefore = processCpuUsec(pid);
+    long long start = monotonicUsec();
+    for (std::size_t first = 0; complete && first < clients; first += batch) {
+        std::size_t last = std::min(clients, first + batch);
+        for (std::size_t i = first; i < last; ++i) {
+            driver.open(nickFor("rg", i));
+        }
+        complete = driver.run([&] { return driver.welcomed() == last; });
+    }
+    long long elapsed = monotonicUsec() - start;
+    long long cpu = processCpuUsec(pid) - cpuBefore;
+    std::vector<long long> times = welcomeTimes(driver, 0, driver.conns.size());
+
+    std::cout << "{\"scenario\":\"register\",\"clients\":" << clients
+              << ",\"batch\":" << batch
+              << ",\"welcomed\":" << times.size()
+              << ",\"complete\":" << (complete ? "true" : "false")
+              << ",\"elapsed_us\":" << elapsed
+              << ",\"registrations_per_sec\":" << (elapsed > 0 ? times.size() * 1000000LL / elapsed : 0);
+    printPercentiles("welcome_us", times);
+    if (cpuBefore >= 0 && !times.empty()) {
+        std::cout << ",\"server_cpu_us\":" << cpu
+                  << ",\"server_us_per_registration\":" << cpu / static_cast<long long>(times.size());
+    }
+    std::cout << "}" << std::endl;
+    return complete ? 0 : 1;
+}
+
+// storm: clients=N opens N connections at once, as after a restart. A
+// client registered beforehand pings the server throughout, showing
+// whether the loop stays responsive while the queue is worked off.
+static int stormScenario(const Options &options)
+{
+    Driver driver(options);
+    std::size_t clients = optionLong(options, "clients", 2000);
+    long pid = optionLong(options, "pid", 0);
+
+    if (!registerAll(driver, 1, "probe")) {
+        std::cerr << "registration timed out" << std::endl;
+        return 1;
+    }
+    long long cpuBefore = processCpuUsec(pid);
+    long long start = monotonicUsec();
+    for (std::size_t i = 0; i < clients; ++i) {
+        driver.open(nickFor("st", i));
+    }
+    long long connected = monotonicUsec() - start;
+
+    std::vector<long long> pings;
+    long pongs = driver.conns[0].pongs;
+    long long pingSent = monotonicUsec();
+    driver.send(0, "PING probe");
+    bool complete = driver.run([&] {
+        if (driver.conns[0].pongs > pongs) {
+            long long now = monotonicUsec();
+            pings.push_back(now - pingSent);
+            pongs = driver.conns[0].pongs;
+            pingSent = now;
+            driver.send(0, "PING probe");
+        }
+        return driver.welcomed() == clients + 1;
+    });
+    long long elapsed = monotonicUsec() - start;
+    long long cpu = processCpuUsec(pid) - cpuBefore;
+    std::vector<long long> times = welcomeTimes(driver, 1, driver.conns.size());
+    std::sort(pings.begin(), pings.end());
+
+    std::cout << "{\"scenario\":\"storm\",\"clients\":" << clients
+              << ",\"welcomed\":" << times.size()
+              << ",\"closed_by_server\":" << driver.closedByServer()
+              << ",\"complete\":" << (complete ? "true" : "false")
+              << ",\"connect_us\":" << connected
+              << ",\"elapsed_us\":" << elapsed
+              << ",\"registrations_per_sec\":" << (elapsed > 0 ? times.size() * 1000000LL / elapsed : 0);
+    printPercentiles("welcome_us", times);
+    printPercentiles("probe_ping_us", pings);
+    if (cpuBefore >= 0) {
+        std::cout << ",\"server_cpu_us\":" << cpu;
+    }
+    std::cout << "}" << std::endl;
+    return complete ? 0 : 1;
+}
+
+// churn: clients=N rounds=R seed=S keeps N clients in one channel while,
+// each round, one in ten of them drops its connection (FIN or RST), sends
+// QUIT, changes nick (sometimes to a nick in use) or messages another by
+// nick. Dropped clients come back on a new connection under a new nick.
+// Every round ends with a barrier, so the server has to keep answering
+// throughout; meant to be run against a sanitizer build (bench/stress.sh).
+static int churnScenario(const Options &options)
+{
+    Driver driver(options);
+    std::size_t clients = optionLong(options, "clients", 200);
+    long rounds = optionLong(options, "rounds", 100);
+    std::vector<std::size_t> slots;
+    std::size_t nicks = 0;
+    long drops = 0, quits = 0, nickChanges = 0, messages = 0;
+
+    std::srand(static_cast<unsigned int>(optionLong(options, "seed", 1)));
+    if (!registerAll(driver, clients, "ch")) {
+        std::cerr << "registration timed out" << std::endl;
+        return 1;
+    }
+    for (std::size_t i = 0; i < clients; ++i) {
+        slots.push_back(i);
+        driver.send(i, "JOIN #churn");
+    }
+
+    long long start = monotonicUsec();
+    bool complete = barrier(driver);
+    for (long round = 0; complete && round < rounds; ++round) {
+        for (std::size_t slot = 0; slot < slots.size(); ++slot) {
+            if (std::rand() % 10 != 0) {
+                continue;
+            }
+            std::size_t index = slots[slot];
+            std::size_t other = slots[std::rand() % slots.size()];
+            switch (std::rand() % 5) {
+                case 0:
+                case 1:
+                    if (std::rand() % 2) {
+                        driver.reset(index);
+                    } else {
+                        driver.close(index);
+                    }
+                    ++drops;
+                    slots[slot] = driver.open(nickFor("cr", nicks++));
+                    driver.send(slots[slot], "JOIN #churn");
+                    break;
+                case 2:
+                    driver.send(index, "QUIT :churn");
+                    ++quits;
+                    slots[slot] = driver.open(nickFor("cr", nicks++));
+                    driver.send(slots[slot], "JOIN #churn");
+                    break;
+                case 3:
+                    // only a welcomed client's nick is sure to be taken;
+                    // a newcomer's must stay free for its registration.
+                    // Nicks compare case-insensitively.
+                    if (std::rand() % 2 && driver.conns[other].welcomedAt != 0) {
+                        std::string taken = driver.conns[other].nick;
+                        std::transform(taken.begin(), taken.end(), taken.begin(), ::toupper);
+                        driver.send(index, "NICK " + taken);
+                    } else {
+                        driver.conns[index].nick = nickFor("cn", nicks++);
+                        driver.send(index, "NICK " + driver.conns[index].nick);
+                    }
+                    ++nickChanges;
+                    break;
+                default:
+                    driver.send(index, "PRIVMSG " + driver.conns[other].nick + " :churn");
+                    driver.send(index, "PRIVMSG #churn :churn");
+                    messages += 2;
+                    break;
+            }
+        }
+        complete = barrier(driver);
+    }
+    long long elapsed = monotonicUsec() - start;
+    std::size_t welcomed = 0;
+    for (std::size_t slot = 0; slot < slots.size(); ++slot) {
+        welcomed += driver.conns[slots[slot]].welcomedAt != 0;
+    }
+    complete = complete && welcomed == slots.size();
+
+    std::cout << "{\"scenario\":\"churn\",\"clients\":" << clients
+              << ",\"rounds\":" << rounds
+              << ",\"connections\":" << driver.conns.size()
+              << ",\"drops\":" << drops
+              << ",\"quits\":" << quits
+              << ",\"nick_changes\":" << nickChanges
+              << ",\"messages\":" << messages
+              << ",\"complete\":" << (complete ? "true" : "false")
+              << ",\"elapsed_us\":" << elapsed << "}" << std::endl;
+    return complete ? 0 : 1;
+}
+
+// idle: clients=N channels=C joins=K settle=S pid=P registers N clients
+// and has each join K of C channels, then leaves them idle. The server's
+// RSS is read before, after registration and after the joins, each time
+// S seconds after the server has answered everything. Reports bytes per
+// connection and per channel membership; pid= is required.
+static int idleScenario(const Options &options)
+{
+    Driver driver(options);
+    std::size_t clients = optionLong(options, "clients", 10000);
+    long channels = std::max(1L, optionLong(options, "channels", 100));
+    long joins = std::min(channels, optionLong(options, "joins", 3));
+    long settle = optionLong(options, "settle", 1);
+    long pid = optionLong(options, "pid", 0);
+
+    long long before = processRssBytes(pid);
+    if (before < 0) {
+        std::cerr << "idle needs pid= of the server" << std::endl;
+        return 2;
+    }
+    if (!registerAll(driver, clients, "id") || !barrier(driver)) {
+        std::cerr << "registration timed out" << std::endl;
+        return 1;
+    }
+    sleep(settle);
+    long long registered = processRssBytes(pid);
+
+    for (std::size_t i = 0; i < clients; ++i) {
+        for (long j = 0; j < joins; ++j) {
+            std::ostringstream join;
+            join << "JOIN #idle" << (i + j) % channels;
+            driver.send(i, join.str());
+        }
+    }
+    bool complete = barrier(driver);
+    sleep(settle);
+    long long joined = processRssBytes(pid);
+    long long memberships = static_cast<long long>(clients) * joins;
+
+    std::cout << "{\"scenario\":\"idle\",\"clients\":" << clients
+              << ",\"channels\":" << channels
+              << ",\"memberships\":" << memberships
+              << ",\"settle_s\":" << settle
+              << ",\"complete\":" << (complete ? "true" : "false")
+              << ",\"rss_before\":" << before
+              << ",\"rss_registered\":" << registered
+              << ",\"rss_joined\":" << joined
+              << ",\"bytes_per_connection\":" << (registered - before) / static_cast<long long>(clients)
+              << ",\"bytes_per_membership\":" << (memberships ? (joined - registered) / memberships : 0)
+              << "}" << std::endl;
+    return complete ? 0 : 1;
+}
+
+// soak: clients=N batch=B hold=S registers N clients, B at a time, then
+// holds them all for S seconds, answering the server's PINGs, while the
+// first client pings once a second. Fails if anyone is not welcomed or
+// is dropped by the server. 100k clients need sources=4 or more and
+// RLIMIT_NOFILE room on both ends; this process raises its own soft
+// limit to the hard one.
+static int soakScenario(const Options &options)
+{
+    Driver driver(options);
+    std::size_t clients = std::max(1L, optionLong(options, "clients", 100000));
+    std::size_t batch = std::max(1L, optionLong(options, "batch", 1000));
+    long hold = optionLong(options, "hold", 60);
+    long pid = optionLong(options, "pid", 0);
+    struct rlimit limit;
+    bool complete = true;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    long long rssBefore = processRssBytes(pid);
+    long long start = monotonicUsec();
+    for (std::size_t first = 0; complete && first < clients; first += batch) {
+        std::size_t last = std::min(clients, first + batch);
+        for (std::size_t i = first; i < last; ++i) {
+            driver.open(nickFor("sk", i));
+        }
+        complete = driver.run([&] { return driver.welcomed() == last; });
+    }
+    long long registerUsec = monotonicUsec() - start;
+    long long rssRegistered = processRssBytes(pid);
+
+    long long cpuBefore = processCpuUsec(pid);
+    long long end = monotonicUsec() + hold * 1000000LL;
+    std::vector<long long> pings;
+    while (complete && !driver.conns[0].closed && monotonicUsec() < end) {
+        long long sentAt = monotonicUsec();
+        long pongs = driver.conns[0].pongs;
+        driver.send(0, "PING soak");
+        if (!driver.run([&] { return driver.conns[0].closed || driver.conns[0].pongs > pongs; })) {
+            break;
+        }
+        pings.push_back(monotonicUsec() - sentAt);
+        long long next = sentAt + 1000000;
+        driver.run([&] { return monotonicUsec() >= next; });
+    }
+    long long cpu = processCpuUsec(pid) - cpuBefore;
+    std::size_t open = 0;
+    for (std::size_t i = 0; i < driver.conns.size(); ++i) {
+        open += !driver.conns[i].closed;
+    }
+    complete = complete && open == clients && driver.closedByServer() == 0;
+    std::sort(pings.begin(), pings.end());
+
+    std::cout << "{\"scenario\":\"soak\",\"clients\":" << clients
+              << ",\"welcomed\":" << driver.welcomed()
+              << ",\"open\":" << open
+              << ",\"closed_by_server\":" << driver.closedByServer()
+              << ",\"complete\":" << (complete ? "true" : "false")
+              << ",\"register_us\":" << registerUsec
+              << ",\"hold_s\":" << hold;
+    printPercentiles("probe_ping_us", pings);
+    if (rssBefore >= 0) {
+        std::cout << ",\"rss_before\":" << rssBefore
+                  << ",\"rss_registered\":" << rssRegistered
+                  << ",\"server_cpu_us_while_held\":" << cpu;
+    }
+    std::cout << "}" << std::endl;
+    return complete ? 0 : 1;
+}
+
+// quitstorm: clients=N channels=C registers N clients, spread over C
+// channels when C > 0, then has all of them send QUIT at once, as in a
+// netsplit or before a restart. Reports how long the server took to
+// close every connection and the CPU it spent doing so.
+static int quitStormScenario(const Options &options)
+{
+    Driver driver(options);
+    std::size_t clients = std::max(1L, optionLong(options, "clients", 2000));
+    long channels = optionLong(options, "channels", 0);
+    long pid = optionLong(options, "pid", 0);
+
+    if (!registerAll(driver, clients, "qs")) {
+        std::cerr << "registration timed out" << std::endl;
+        return 1;
+    }
+    for (std::size_t i = 0; channels > 0 && i < clients; ++i) {
+        std::ostringstream join;
+        join << "JOIN #storm" << i % channels;
+        driver.send(i, join.str());
+    }
+    if (!barrier(driver)) {
+        std::cerr << "barrier timed out" << std::endl;
+        return 1;
+    }
+
+    long long cpuBefore = processCpuUsec(pid);
+    long long start = monotonicUsec();
+    for (std::size_t i = 0; i < clients; ++i) {
+        driver.send(i, "QUIT :storm");
+    }
+    bool complete = driver.run([&] { return driver.closedByServer() == clients; });
+    long long elapsed = monotonicUsec() - start;
+    long long cpu = processCpuUsec(pid) - cpuBefore;
+
+    std::cout << "{\"scenario\":\"quitstorm\",\"clients\":" << clients
+              << ",\"channels\":" << channels
+              << ",\"closed\":" << driver.closedByServer()
+              << ",\"complete\":" << (complete ? "true" : "false")
+              << ",\"elapsed_us\":" << elapsed;
+    if (cpuBefore >= 0) {
+        std::cout << ",\"server_cpu_us\":" << cpu
+                  << ",\"server_us_per_quit\":" << cpu / static_cast<long long>(clients);
+    }
+    std::cout << "}" << std::endl;
+    return complete ? 0 : 1;
+}
+
+// fairness: probes=N interval=MS duration=S size=B shows what one
+// flooding client costs everyone else. N probe clients each ping every
+// MS milliseconds, first for S seconds on a quiet server, then for S
+// seconds while one more client sends B-byte PRIVMSGs to a channel of
+// its own as fast as the server takes them. Reports the probes'
+// PING->PONG percentiles in both phases and the flooder's lines per
+// second. Polls busily unless busy=0 is given.
+static int fairnessScenario(const Options &options)
+{
+    Options busy(options);
+    busy.insert(std::make_pair(std::string("busy"), std::string("1")));
+    Driver driver(busy);
+    std::size_t probes = std::max(1L, optionLong(options, "probes", 50));
+    long long interval = std::max(1L, optionLong(options, "interval", 100)) * 1000LL;
+    long long duration = optionLong(options, "duration", 10) * 1000000LL;
+    std::size_t size = optionLong(options, "size", 200);
+    long pid = optionLong(options, "pid", 0);
+    std::size_t flooder = probes;
+
+    if (!registerAll(driver, probes + 1, "fa")) {
+        std::cerr << "registration timed out" << std::endl;
+        return 1;
+    }
+    driver.send(flooder, "JOIN #fairness");
+    if (!barrier(driver)) {
+        std::cerr << "barrier timed out" << std::endl;
+        return 1;
+    }
+
+    std::string line = "PRIVMSG #fairness :" + std::string(size, 'x') + "\r\n";
+    std::vector<long long> rtts[2];
+    long long queued = 0;
+    long long cpu = 0;
+    for (int phase = 0; phase < 2; ++phase) {
+        long long start = monotonicUsec();
+        long long cpuBefore = processCpuUsec(pid);
+        std::vector<long long> nextAt(probes);
+        std::vector<long long> sentAt(probes, 0);
+        std::vector<long> pongs(probes);
+        for (std::size_t i = 0; i < probes; ++i) {
+            nextAt[i] = start + interval * i / probes;
+            pongs[i] = driver.conns[i].pongs;
+        }
+        driver.run([&] {
+            long long now = monotonicUsec();
+            for (std::size_t i = 0; i < probes; ++i) {
+                if (sentAt[i] != 0 && driver.conns[i].pongs > pongs[i]) {
+                    rtts[phase].push_back(driver.conns[i].lastPongAt - sentAt[i]);
+                    pongs[i] = driver.conns[i].pongs;
+                    sentAt[i] = 0;
+                }
+                if (sentAt[i] == 0 && now >= nextAt[i]) {
+                    driver.send(i, "PING fairness");
+                    sentAt[i] = now;
+                    nextAt[i] += interval;
+                }
+            }
+            // keep the flooder's socket full
+            while (phase == 1 && driver.conns[flooder].output.size() < 65536) {
+                driver.conns[flooder].output += line;
+                ++queued;
+            }
+            return now - start >= duration;
+        });
+        cpu = processCpuUsec(pid) - cpuBefore;
+    }
+    long long sent = queued - static_cast<long long>(driver.conns[flooder].output.size() / line.size());
+    std::sort(rtts[0].begin(), rtts[0].end());
+    std::sort(rtts[1].begin(), rtts[1].end());
+
+    std::cout << "{\"scenario\":\"fairness\",\"probes\":" << probes
+              << ",\"interval_ms\":" << interval / 1000
+              << ",\"line_bytes\":" << line.size()
+              << ",\"closed_by_server\":" << driver.closedByServer()
+              << ",\"flood_lines_per_sec\":" << (duration > 0 ? sent * 1000000 / duration : 0);
+    printTailPercentiles("quiet_ping_us", rtts[0]);
+    printTailPercentiles("flooded_ping_us", rtts[1]);
+    if (pid > 0) {
+        std::cout << ",\"server_cpu_us_flooded\":" << cpu;
+    }
+    std::cout << "}" << std::endl;
+    return driver.closedByServer() == 0 ? 0 : 1;
+}
+
+// flood: clients=N lines=L size=B channel traffic from N members of one
+// channel, L lines of B bytes each. Reports lines processed per second
+// and, with pid=, server CPU per line.
+static int floodScenario(const Options &options)
+{
+    Driver driver(options);
+    std::size_t clients = optionLong(options, "clients", 20);
+    long lines = optionLong(options, "lines", 2000);
+    std::size_t size = optionLong(options, "size", 200);
+    long pid = optionLong(options, "pid", 0);
+
+    if (!registerAll(driver, clients, "fl")) {
+        std::cerr << "registration timed out" << std::endl;
+        return 1;
+    }
+    for (std::size_t i = 0; i < clients; ++i) {
+        driver.send(i, "JOIN #flood");
+    }
+    barrier(driver);
+
+    std::string text(size, 'x');
+    for (std::size_t i = 0; i < text.size(); i += 7) {
+        text[i] = ' ';
+    }
+    long long cpuBefore = processCpuUsec(pid);
+    long long start = monotonicUsec();
+    for (long n = 0; n < lines; ++n) {
+        for (std::size_t i = 0; i < clients; ++i) {
+            driver.send(i, "PRIVMSG #flood :" + text);
+        }
+    }
+    bool complete = barrier(driver);
+    long long elapsed = monotonicUsec() - start;
+    long long cpu = processCpuUsec(pid) - cpuBefore;
+    long long total = lines * static_cast<long long>(clients);
+
+    std::cout << "{\"scenario\":\"flood\",\"clients\":" << clients
+              << ",\"lines\":" << total
+              << ",\"line_bytes\":" << size
+              << ",\"complete\":" << (complete ? "true" : "false")
+              << ",\"elapsed_us\":" << elapsed
+              << ",\"lines_per_sec\":" << (elapsed > 0 ? total * 1000000 / elapsed : 0);
+    if (cpuBefore >= 0) {
+        std::cout << ",\"server_cpu_us\":" << cpu
+                  << ",\"server_ns_per_line\":" << cpu * 1000 / total;
+    }
+    std::cout << "}" << std::endl;
+    return complete ? 0 : 1;
+}
+
+struct Scenario {
+    const char  *name;
+    int         (*run)(const Options &options);
+};
+
+static const Scenario scenarios[] = {
+    { "flood", floodScenario },
+    { "register", registerScenario },
+    { "storm", stormScenario },
+    { "churn", churnScenario },
+    { "idle", idleScenario },
+    { "soak", soakScenario },
+    { "quitstorm", quitStormScenario },
+    { "fairness", fairnessScenario },
+};
+
+int main(int argc, char **argv)
+{
+    Options options;
+
+    for (int i = 2; i < argc; ++i) {
+        std::string arg(argv[i]);
+        std::size_t equals = arg.find('=');
+        if (equals == std::string::npos) {
+            std::cerr << "expected key=value: " << arg << std::endl;
+            return 2;
+        }
+        options[arg.substr(0, equals)] = arg.substr(equals + 1);
+    }
+    for (std::size_t i = 0; argc > 1 && i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+        if (std::strcmp(argv[1], scenarios[i].name) == 0) {
+            return scenarios[i].run(options);
+        }
+    }
+    std::cerr << "Usage: " << argv[0] << " <scenario> [key=value ...]" << std::endl << "Scenarios:";
+    for (std::size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+        std::cerr << " " << scenarios[i].name;
+    }
+    std::cerr << std::endl;
+    return 2;
+}
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Runs bench/loadgen churn against an AddressSanitizer/UBSan build of the
+# server, then shuts it down cleanly so LeakSanitizer reports as well.
+# Fails if loadgen does not complete or the server exits with a report.
+#
+#   bench/stress.sh [port] [key=value ...]     (make stress)
+
+PORT=${1:-6697}
+[ $# -gt 0 ] && shift
+LOG=$(mktemp /tmp/ircserv-stress.XXXXXX)
+SANITIZE="-fsanitize=address,undefined -fno-omit-frame-pointer"
+
+make --no-print-directory fclean
+make --no-print-directory all bench/loadgen \
+	CXXFLAGS="-Wall -Werror -Wextra -std=c++17 -g $SANITIZE" \
+	LDLIBS="-lz $SANITIZE" || exit 1
+
+UBSAN_OPTIONS=halt_on_error=1:print_stacktrace=1 ./ircserv "$PORT" stress > "$LOG" 2>&1 &
+SERVER=$!
+sleep 1
+
+bench/loadgen churn port="$PORT" pass=stress "$@"
+LOADGEN=$?
+
+kill -INT $SERVER
+wait $SERVER
+STATUS=$?
+
+if [ $LOADGEN -ne 0 ] || [ $STATUS -ne 0 ] || grep -q "Sanitizer\|runtime error" "$LOG"; then
+	grep -A30 "Sanitizer\|runtime error" "$LOG" | head -60
+	echo "stress: FAILED (loadgen $LOADGEN, server $STATUS), log in $LOG"
+	exit 1
+fi
+rm -f "$LOG"
+echo "stress: OK"